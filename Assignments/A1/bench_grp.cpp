@@ -0,0 +1,284 @@
+// Load generator for the chat server: every client logs in as a different user from users.txt and
+// sends private messages to itself, waiting for each one to come back (ping-pong over the server).
+// Clients connect over TCP, a Unix socket (server started with --unix) or shared memory (--shm).
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include "local_transport.h"
+
+#define PORT 12345
+#define BUFFER_SIZE 1024
+
+struct BenchOptions
+{
+    int clients = 4;                       // number of concurrent connections (one user each)
+    int messages = 10000;                  // round trips per client
+    std::string users_file = "users.txt";  // credentials, same format as the server's users.txt
+    std::string transport = "tcp";         // tcp, unix or shm
+    std::string path;                      // Unix socket of the unix and shm transports
+};
+
+struct Connection // a client connection over any of the transports
+{
+    int sock = -1;
+    ShmRegion *region = nullptr; // set for shared-memory connections
+    int to_server_doorbell = -1;
+    int to_client_doorbell = -1;
+};
+
+struct ClientResult
+{
+    bool ok = false;
+    std::vector<long long> latencies_ns; // one entry per round trip
+};
+
+std::atomic<int> ready_clients{0}; // clients that finished logging in
+std::atomic<bool> start{false};    // set once every client is ready
+
+bool load_credentials(const std::string &users_file, std::vector<std::pair<std::string, std::string>> &credentials)
+{
+    std::ifstream file(users_file);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << users_file << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        std::string password = line.substr(colon + 1);
+        if (!password.empty() && password.back() == '\r')
+            password.pop_back();
+        credentials.push_back({line.substr(0, colon), password});
+    }
+    return true;
+}
+
+int connect_unix(const std::string &path, int type) // function to connect to a Unix socket, returns -1 on failure
+{
+    int sock = socket(AF_UNIX, type, 0);
+    if (sock < 0)
+        return -1;
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool connect_to_server(const BenchOptions &options, Connection &conn) // function to connect over the chosen transport
+{
+    if (options.transport == "unix")
+    {
+        conn.sock = connect_unix(options.path, SOCK_STREAM);
+        return conn.sock >= 0;
+    }
+    if (options.transport == "shm")
+    {
+        conn.sock = connect_unix(options.path, SOCK_SEQPACKET);
+        std::string record;
+        std::vector<int> fds;
+        if (conn.sock < 0 || !recv_record(conn.sock, record, fds) || record != "SHM" || fds.size() != 3)
+            return false;
+        void *region = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        close(fds[0]);
+        if (region == MAP_FAILED)
+            return false;
+        conn.region = (ShmRegion *)region;
+        conn.to_server_doorbell = fds[1];
+        conn.to_client_doorbell = fds[2];
+        return true;
+    }
+
+    conn.sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn.sock < 0)
+        return false;
+
+    sockaddr_in server_address{};
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(PORT);
+    server_address.sin_addr.s_addr = inet_addr("127.0.0.1");
+    return connect(conn.sock, (sockaddr *)&server_address, sizeof(server_address)) == 0;
+}
+
+void disconnect(Connection &conn)
+{
+    if (conn.region)
+    {
+        munmap(conn.region, sizeof(ShmRegion));
+        close(conn.to_server_doorbell);
+        close(conn.to_client_doorbell);
+    }
+    if (conn.sock >= 0)
+        close(conn.sock);
+}
+
+bool wait_for(Connection &conn, const std::string &expected) // function to read until a message containing expected arrives
+{
+    char buffer[BUFFER_SIZE];
+    while (true)
+    {
+        int bytes_received;
+        if (conn.region)
+        {
+            pollfd hangup{conn.sock, POLLIN, 0};
+            bytes_received = shm_ring_wait(&conn.region->to_client, conn.to_client_doorbell, &hangup, 1)
+                                 ? shm_ring_pop(&conn.region->to_client, buffer, BUFFER_SIZE)
+                                 : 0;
+        }
+        else
+        {
+            bytes_received = recv(conn.sock, buffer, BUFFER_SIZE, 0);
+        }
+        if (bytes_received <= 0)
+            return false;
+        if (std::string(buffer, bytes_received).find(expected) != std::string::npos)
+            return true;
+    }
+}
+
+bool send_message(Connection &conn, const std::string &message)
+{
+    if (!conn.region)
+        return send(conn.sock, message.c_str(), message.size(), 0) == (ssize_t)message.size();
+
+    while (!shm_ring_push(&conn.region->to_server, conn.to_server_doorbell, message.c_str(), message.size()))
+        usleep(100); // the server is behind, wait for room in the ring
+    return true;
+}
+
+void run_client(const BenchOptions &options, const std::string &username, const std::string &password, ClientResult *result)
+{
+    Connection conn;
+    bool logged_in = connect_to_server(options, conn) &&
+                     wait_for(conn, "Enter username") && send_message(conn, username) &&
+                     wait_for(conn, "Enter password") && send_message(conn, password) &&
+                     wait_for(conn, "Welcome") &&
+                     send_message(conn, "/presence off") && wait_for(conn, "Presence notifications turned off");
+    ++ready_clients;
+    if (!logged_in)
+    {
+        std::cerr << "Login as " << username << " failed." << std::endl;
+        disconnect(conn);
+        return;
+    }
+
+    while (!start)
+        std::this_thread::yield();
+
+    result->latencies_ns.reserve(options.messages);
+    for (int i = 0; i < options.messages; ++i)
+    {
+        std::string tag = "ping " + std::to_string(i);
+        auto sent = std::chrono::steady_clock::now();
+        if (!send_message(conn, "/msg " + username + " " + tag) || !wait_for(conn, tag))
+        {
+            std::cerr << username << ": connection lost after " << i << " messages." << std::endl;
+            disconnect(conn);
+            return;
+        }
+        result->latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sent).count());
+    }
+
+    send_message(conn, "/exit");
+    disconnect(conn);
+    result->ok = true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--clients" && i + 1 < argc)
+            options.clients = std::atoi(argv[++i]);
+        else if (arg == "--messages" && i + 1 < argc)
+            options.messages = std::atoi(argv[++i]);
+        else if (arg == "--users" && i + 1 < argc)
+            options.users_file = argv[++i];
+        else if (arg == "--transport" && i + 1 < argc)
+            options.transport = argv[++i];
+        else if (arg == "--path" && i + 1 < argc)
+            options.path = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--clients <N>] [--messages <M>] [--users <users_file>] [--transport tcp|unix|shm --path <unix_path>]" << std::endl;
+            return 1;
+        }
+    }
+    if (options.transport != "tcp" && (options.path.empty() || (options.transport != "unix" && options.transport != "shm")))
+    {
+        std::cerr << "The unix and shm transports need the server's Unix socket path (--path)." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::string>> credentials;
+    if (!load_credentials(options.users_file, credentials))
+        return 1;
+    if (options.clients < 1 || options.clients > (int)credentials.size())
+    {
+        std::cerr << "Need between 1 and " << credentials.size() << " clients (one per user in " << options.users_file << ")." << std::endl;
+        return 1;
+    }
+
+    std::vector<ClientResult> results(options.clients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.clients; ++i)
+        threads.emplace_back(run_client, std::cref(options), credentials[i].first, credentials[i].second, &results[i]);
+
+    while (ready_clients < options.clients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (std::thread &thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::vector<long long> latencies;
+    int failed = 0;
+    for (const ClientResult &result : results)
+    {
+        failed += !result.ok;
+        latencies.insert(latencies.end(), result.latencies_ns.begin(), result.latencies_ns.end());
+    }
+    if (latencies.empty())
+    {
+        std::cerr << "No message made the round trip." << std::endl;
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile_us = [&](double p)
+    { return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000.0; };
+
+    std::cout << "transport: " << options.transport << std::endl;
+    std::cout << "clients: " << options.clients << " (" << failed << " failed)" << std::endl;
+    std::cout << "round trips: " << latencies.size() << " in " << seconds << " s" << std::endl;
+    std::cout << "throughput: " << (long long)(latencies.size() / seconds) << " msgs/s" << std::endl;
+    std::cout << "latency us: p50 " << percentile_us(0.50) << "  p90 " << percentile_us(0.90)
+              << "  p99 " << percentile_us(0.99) << "  max " << latencies.back() / 1000.0 << std::endl;
+    return failed ? 1 : 0;
+}
@@ -10,13 +10,31 @@
 #include <sstream>
 #include <cstring>
 #include <cstdlib>
+#include <fstream>
+#include <chrono>
 #include <unistd.h>
 #include <arpa/inet.h>
 
 #define BUFFER_SIZE 1024
+#define DEFAULT_DRAIN_MS 1000
 
 std::mutex cout_mutex;
 
+struct TraceEntry // one timestamped command of a replay trace
+{
+    long long offset_ms; // time of the command relative to the first command of the trace
+    std::string command; // line sent to the server as is
+};
+
+struct ReplayOptions // options of the scripted replay mode
+{
+    std::string trace_file;                   // trace to replay
+    std::string record_file;                  // where send/receive timestamps are written (stdout if empty)
+    double speed = 1.0;                       // 1 = real speed, N = N times faster
+    bool fast = false;                        // ignore timestamps and send as fast as possible
+    long long drain_ms = DEFAULT_DRAIN_MS;    // how long to keep listening after the last command
+};
+
 void handle_server_messages(int server_socket)
 {
     char buffer[BUFFER_SIZE];
@@ -36,18 +54,16 @@ void handle_server_messages(int server_socket)
     }
 }
 
-int main()
+int connect_to_server() // function to open a TCP connection to the chat server, returns -1 on failure
 {
-    int client_socket;
-    sockaddr_in server_address{};
-
-    client_socket = socket(AF_INET, SOCK_STREAM, 0);
+    int client_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (client_socket < 0)
     {
         std::cerr << "Error creating socket." << std::endl;
-        return 1;
+        return -1;
     }
 
+    sockaddr_in server_address{};
     server_address.sin_family = AF_INET;
     server_address.sin_port = htons(12345);
     server_address.sin_addr.s_addr = inet_addr("127.0.0.1");
@@ -55,9 +71,263 @@ int main()
     if (connect(client_socket, (sockaddr *)&server_address, sizeof(server_address)) < 0)
     {
         std::cerr << "Error connecting to server." << std::endl;
+        close(client_socket);
+        return -1;
+    }
+    return client_socket;
+}
+
+// Trace format: the first two non-comment lines are the username and the password,
+// every following line is "<offset_ms> <command>". Lines starting with '#' are ignored.
+bool load_trace(const std::string &trace_file, std::string &username, std::string &password, std::vector<TraceEntry> &trace)
+{
+    std::ifstream file(trace_file);
+    if (!file)
+    {
+        std::cerr << "Failed to open trace file " << trace_file << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int header_lines = 0;
+    int line_no = 0;
+    while (std::getline(file, line))
+    {
+        ++line_no;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        if (header_lines == 0)
+        {
+            username = line;
+            ++header_lines;
+            continue;
+        }
+        if (header_lines == 1)
+        {
+            password = line;
+            ++header_lines;
+            continue;
+        }
+
+        size_t space = line.find(' ');
+        TraceEntry entry;
+        try
+        {
+            entry.offset_ms = std::stoll(line.substr(0, space));
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid timestamp on line " << line_no << " of " << trace_file << std::endl;
+            return false;
+        }
+        entry.command = (space == std::string::npos) ? "" : line.substr(space + 1);
+        if (entry.command.empty()) // nothing to send
+            continue;
+        trace.push_back(entry);
+    }
+
+    if (header_lines < 2)
+    {
+        std::cerr << "Trace file must start with a username and a password line." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The replay mode ends every line it sends with '\n'. The server then handles each line as a command
+// of its own, however the lines arrive, and ends each message it sends back with a '\n' as well.
+bool read_line(int client_socket, std::string &pending, std::string &line) // function to read one message of a framed session
+{
+    char buffer[BUFFER_SIZE];
+    size_t newline;
+    while ((newline = pending.find('\n')) == std::string::npos)
+    {
+        int bytes_received = recv(client_socket, buffer, BUFFER_SIZE, 0);
+        if (bytes_received <= 0)
+            return false;
+        pending.append(buffer, bytes_received);
+    }
+    line = pending.substr(0, newline);
+    pending.erase(0, newline + 1);
+    return true;
+}
+
+bool send_line(int client_socket, const std::string &line) // function to send one '\n'-terminated line
+{
+    std::string framed = line + "\n";
+    return send(client_socket, framed.c_str(), framed.size(), 0) == (ssize_t)framed.size();
+}
+
+// Non-interactive version of the login in main(). Whatever the server sent after the welcome
+// message is left in pending.
+bool login(int client_socket, const std::string &username, const std::string &password, std::string &pending)
+{
+    char buffer[BUFFER_SIZE];
+    std::string line;
+
+    memset(buffer, 0, BUFFER_SIZE);
+    recv(client_socket, buffer, BUFFER_SIZE, 0); // "Enter username: ", not framed yet
+    send_line(client_socket, username);
+
+    read_line(client_socket, pending, line); // "Enter password: "
+    send_line(client_socket, password);
+
+    // welcome message or "Authentication failed."
+    if (!read_line(client_socket, pending, line) || line.find("Authentication failed") != std::string::npos)
+    {
+        std::cerr << "Login as " << username << " failed." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string csv_quote(const std::string &text) // function to quote a CSV field, doubling the quotes inside it
+{
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Receiving thread of the replay mode: every server message is recorded with the time it arrived
+// (microseconds since the replay started) instead of being printed to the terminal.
+void record_server_messages(int server_socket, std::chrono::steady_clock::time_point start, std::ostream *record, size_t *received, std::string pending)
+{
+    std::string message;
+    while (read_line(server_socket, pending, message))
+    {
+        long long now_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        *record << "recv," << now_us << "," << message.size() << "," << csv_quote(message) << "\n";
+        ++*received;
+    }
+}
+
+int replay_trace(const ReplayOptions &options) // function to replay a trace file against the server
+{
+    std::string username, password;
+    std::vector<TraceEntry> trace;
+    if (!load_trace(options.trace_file, username, password, trace))
+        return 1;
+
+    std::ofstream record_file;
+    std::ostream *record = &std::cout;
+    if (!options.record_file.empty())
+    {
+        record_file.open(options.record_file);
+        if (!record_file)
+        {
+            std::cerr << "Failed to open record file " << options.record_file << std::endl;
+            return 1;
+        }
+        record = &record_file;
+    }
+
+    int client_socket = connect_to_server();
+    if (client_socket < 0)
+        return 1;
+    std::string pending; // server messages that arrived with the welcome message
+    if (!login(client_socket, username, password, pending))
+    {
+        close(client_socket);
         return 1;
     }
 
+    // The clock starts after login so that offsets in the trace are relative to the first command.
+    auto start = std::chrono::steady_clock::now();
+    long long first_offset = trace.empty() ? 0 : trace.front().offset_ms;
+    size_t received = 0;
+    *record << "event,time_us,bytes,message\n";
+    std::thread receive_thread(record_server_messages, client_socket, start, record, &received, pending);
+
+    bool exited = false;
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        const TraceEntry &entry = trace[i];
+        if (!options.fast)
+        {
+            auto due = start + std::chrono::microseconds((long long)((entry.offset_ms - first_offset) * 1000 / options.speed));
+            std::this_thread::sleep_until(due);
+        }
+
+        long long now_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            *record << "send," << now_us << "," << entry.command.size() << "," << csv_quote(entry.command) << "\n";
+        }
+        if (!send_line(client_socket, entry.command))
+        {
+            std::cerr << "Send failed, server closed the connection." << std::endl;
+            break;
+        }
+
+        if (entry.command == "/exit")
+        {
+            exited = true;
+            break;
+        }
+    }
+
+    // Keep listening for the replies to the last commands, then close the connection.
+    if (!exited)
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.drain_ms));
+    shutdown(client_socket, SHUT_RDWR);
+    receive_thread.join();
+    close(client_socket);
+
+    long long elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    record->flush();
+    std::cerr << "Replayed " << trace.size() << " commands in " << elapsed_ms << " ms, received " << received << " messages." << std::endl;
+    return 0;
+}
+
+void usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [--replay <trace_file> [--speed <N> | --fast] [--record <file>] [--drain <ms>]]" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    ReplayOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--replay" && i + 1 < argc)
+            options.trace_file = argv[++i];
+        else if (arg == "--speed" && i + 1 < argc)
+            options.speed = std::atof(argv[++i]);
+        else if (arg == "--fast")
+            options.fast = true;
+        else if (arg == "--record" && i + 1 < argc)
+            options.record_file = argv[++i];
+        else if (arg == "--drain" && i + 1 < argc)
+            options.drain_ms = std::atoll(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.speed <= 0)
+    {
+        std::cerr << "Speed must be positive." << std::endl;
+        return 1;
+    }
+    if (!options.trace_file.empty())
+        return replay_trace(options);
+
+    int client_socket = connect_to_server();
+    if (client_socket < 0)
+        return 1;
+
     std::cout << "Connected to the server." << std::endl;
 
     // Authentication
@@ -0,0 +1,191 @@
+// Transports for clients running on the same host as server_grp: passing file descriptors over Unix
+// sockets, and a shared-memory ring buffer with an eventfd doorbell used instead of a socket.
+//
+// Shared-memory session setup: the client connects to the server's --shm Unix socket (SOCK_SEQPACKET)
+// and receives one "SHM" record carrying three descriptors: the memfd holding a ShmRegion, the
+// doorbell of the to_server ring and the doorbell of the to_client ring. The Unix connection stays
+// open for the whole session; closing it is how either side notices the other one went away.
+
+#ifndef LOCAL_TRANSPORT_H
+#define LOCAL_TRANSPORT_H
+
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#define SHM_RING_SIZE (1 << 20) // bytes of message data per direction, must be a power of two
+#define MAX_RECORD_FDS 4        // most descriptors attached to one record
+#define MAX_RECORD_SIZE 65536   // longest record recv_record accepts
+
+struct ShmRing // single consumer ring of length-prefixed messages
+{
+    alignas(64) std::atomic<uint64_t> head; // bytes ever written, only advanced by the producer
+    alignas(64) std::atomic<uint64_t> tail; // bytes ever consumed, only advanced by the consumer
+    alignas(64) std::atomic<uint32_t> waiting; // the consumer is (about to be) blocked on the doorbell
+    alignas(64) char data[SHM_RING_SIZE];
+};
+
+struct ShmRegion // layout of the shared memory of one session
+{
+    ShmRing to_server;
+    ShmRing to_client;
+};
+
+inline void shm_copy_in(ShmRing *ring, uint64_t pos, const void *src, size_t len) // copy into the ring, wrapping around
+{
+    size_t offset = pos & (SHM_RING_SIZE - 1);
+    size_t first = std::min(len, (size_t)SHM_RING_SIZE - offset);
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, (const char *)src + first, len - first);
+}
+
+inline void shm_copy_out(const ShmRing *ring, uint64_t pos, void *dst, size_t len) // copy out of the ring, wrapping around
+{
+    size_t offset = pos & (SHM_RING_SIZE - 1);
+    size_t first = std::min(len, (size_t)SHM_RING_SIZE - offset);
+    memcpy(dst, ring->data + offset, first);
+    memcpy((char *)dst + first, ring->data, len - first);
+}
+
+// Appends one message, returns false if there is no room for it. The doorbell is only rung when the
+// consumer announced it is going to sleep, so a busy consumer costs no syscall per message.
+// Callers serialize producers on the same ring.
+inline bool shm_ring_push(ShmRing *ring, int doorbell, const void *msg, uint32_t len)
+{
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    if (SHM_RING_SIZE - (head - tail) < sizeof(len) + len)
+        return false;
+
+    shm_copy_in(ring, head, &len, sizeof(len));
+    shm_copy_in(ring, head + sizeof(len), msg, len);
+    ring->head.store(head + sizeof(len) + len, std::memory_order_seq_cst);
+
+    if (ring->waiting.exchange(0, std::memory_order_seq_cst))
+    {
+        uint64_t one = 1;
+        if (write(doorbell, &one, sizeof(one)) < 0)
+            return true; // the message is queued, the consumer finds it on its next wakeup
+    }
+    return true;
+}
+
+// Removes one message, returns its length or -1 if the ring is empty. Messages longer than size are truncated.
+inline int shm_ring_pop(ShmRing *ring, void *buf, size_t size)
+{
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    if (head == tail)
+        return -1;
+
+    uint32_t len;
+    shm_copy_out(ring, tail, &len, sizeof(len));
+    shm_copy_out(ring, tail + sizeof(len), buf, std::min((size_t)len, size));
+    ring->tail.store(tail + sizeof(len) + len, std::memory_order_release);
+    return std::min((size_t)len, size);
+}
+
+inline bool shm_ring_empty(const ShmRing *ring)
+{
+    return ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed);
+}
+
+// Blocks until the ring has a message or one of the extra descriptors is readable.
+// Returns true if there is a message; extra[i].revents tells which descriptor woke it up otherwise.
+inline bool shm_ring_wait(ShmRing *ring, int doorbell, pollfd *extra, int extra_count)
+{
+    pollfd fds[1 + MAX_RECORD_FDS];
+    fds[0] = {doorbell, POLLIN, 0};
+    for (int i = 0; i < extra_count; ++i)
+        fds[1 + i] = extra[i];
+
+    while (true)
+    {
+        ring->waiting.store(1, std::memory_order_seq_cst);
+        if (!shm_ring_empty(ring)) // a message arrived before the producer could see the flag
+        {
+            ring->waiting.store(0, std::memory_order_relaxed);
+            return true;
+        }
+        if (poll(fds, 1 + extra_count, -1) < 0)
+            continue;
+        ring->waiting.store(0, std::memory_order_relaxed);
+
+        uint64_t count;
+        if (fds[0].revents && read(doorbell, &count, sizeof(count)) < 0)
+            count = 0; // the doorbell is non-blocking, a spurious wakeup just loops
+        if (!shm_ring_empty(ring))
+            return true;
+        for (int i = 0; i < extra_count; ++i)
+        {
+            extra[i].revents = fds[1 + i].revents;
+            if (extra[i].revents)
+                return false;
+        }
+    }
+}
+
+// Sends one record over a SOCK_SEQPACKET Unix socket with the given descriptors attached (SCM_RIGHTS).
+inline bool send_record(int sock, const std::string &record, const std::vector<int> &fds)
+{
+    iovec iov{(void *)record.data(), record.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int) * MAX_RECORD_FDS)];
+    if (!fds.empty())
+    {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    return sendmsg(sock, &msg, 0) == (ssize_t)record.size();
+}
+
+// Receives one record and the descriptors attached to it, returns false when the connection is closed.
+inline bool recv_record(int sock, std::string &record, std::vector<int> &fds)
+{
+    char buffer[MAX_RECORD_SIZE];
+    iovec iov{buffer, sizeof(buffer)};
+    char control[CMSG_SPACE(sizeof(int) * MAX_RECORD_FDS)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t bytes_received = recvmsg(sock, &msg, 0);
+    if (bytes_received <= 0)
+        return false;
+    record.assign(buffer, bytes_received);
+
+    fds.clear();
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            fds.push_back(fd);
+        }
+    }
+    return true;
+}
+
+#endif
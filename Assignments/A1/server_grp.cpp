@@ -12,10 +12,24 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <fstream>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/un.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
+#include "local_transport.h"
 
 #define PORT 12345
 #define BUFFER_SIZE 1024
+#define DEFAULT_PRESENCE_DEBOUNCE_MS 100
+#define MAX_SHM_SOCKET 65536     // shared-memory and newline-framed clients need a socket number below this
+#define SHM_SEND_RETRIES 10000   // 100 us apart, after that a message to a full ring is dropped
+#define GROUP_RECORD_MEMBERS 1000 // group members per handoff record
 
 std::unordered_map<int, std::string> clients; // a mapping to store client socket and username pair
 std::mutex clients_mutex;                     // a mutex to lock the clients mapping
@@ -23,9 +37,156 @@ std::mutex clients_mutex;                     // a mutex to lock the clients map
 std::unordered_map<std::string, std::string> users; // a mapping to store user and password pair
 std::mutex users_mutex;                             // a mutex to lock the users mapping
 
+std::unordered_set<int> presence_opt_out; // client sockets that don't want join/leave notifications, locked by clients_mutex
+
 std::unordered_map<std::string, std::unordered_set<int>> groups; // a mapping to store group name and set of client sockets
 std::mutex groups_mutex;                                         // a mutex to lock the groups mapping
 
+enum SessionStage // how far a connection got through the login
+{
+    NEW,            // nothing sent yet
+    AWAIT_USERNAME, // username prompt sent
+    AWAIT_PASSWORD, // password prompt sent
+    LOGGED_IN       // authenticated and in the clients mapping
+};
+
+struct Session // per connection state that has to survive a handoff to a new server process
+{
+    SessionStage stage = NEW;
+    std::string username;
+    bool framed = false; // the client ends every command with '\n', see read_command()
+    std::string pending; // received part of a framed command whose '\n' has not arrived yet
+};
+
+// Join/leave events waiting to be sent, in order of arrival. A join and a leave of the same user
+// in one window cancel out, which is what a reconnecting client produces.
+std::vector<std::string> presence_order;                // usernames in the order of their first event
+std::unordered_map<std::string, int> presence_net;      // username -> joins minus leaves in the window
+int presence_debounce_ms = DEFAULT_PRESENCE_DEBOUNCE_MS; // length of the window, 0 to send every event at once
+std::mutex presence_mutex;                              // a mutex to lock the pending presence events
+std::condition_variable presence_cv;                    // notified when the first event of a window arrives
+
+// Clients on the same host can connect over a Unix socket (--unix), which needs nothing special, or
+// over shared memory (--shm). A shared-memory client is identified by the Unix socket it set the
+// session up with, so all the mappings and command handlers work unchanged; only sending and
+// receiving go through send_to_client()/recv_from_client().
+struct ShmChannel
+{
+    int memfd = -1;              // shared memory holding the ShmRegion
+    int to_server_doorbell = -1; // eventfd rung when the client queues a message
+    int to_client_doorbell = -1; // eventfd rung when the server queues a message
+    ShmRegion *region = nullptr;
+    std::mutex send_mutex; // serializes threads sending to this client
+};
+std::atomic<ShmChannel *> shm_channels[MAX_SHM_SOCKET]; // client socket -> channel, null for socket clients
+
+// A client that ends its commands with '\n' (client_grp --replay, or netcat) gets every server
+// message with a '\n' at the end too, so that messages sent back to back can be told apart.
+// Clients that never send a '\n' are served one command per recv() and unframed messages, as before.
+std::atomic<bool> framed_clients[MAX_SHM_SOCKET]; // client socket -> newline framing of messages to it
+
+int unix_socket = -1; // listening Unix stream socket, -1 if not enabled
+int shm_socket = -1;  // listening Unix seqpacket socket for shared-memory sessions, -1 if not enabled
+
+ShmChannel *shm_channel(int client_socket) // function to find the shared-memory channel of a client, null if it uses a socket
+{
+    if (client_socket < 0 || client_socket >= MAX_SHM_SOCKET)
+        return nullptr;
+    return shm_channels[client_socket].load(std::memory_order_acquire);
+}
+
+void set_framed(int client_socket, bool framed) // function to turn newline framing of messages to a client on or off
+{
+    if (client_socket >= 0 && client_socket < MAX_SHM_SOCKET)
+        framed_clients[client_socket].store(framed, std::memory_order_relaxed);
+}
+
+ssize_t send_to_client(int client_socket, const void *data, size_t len, int flags) // send() that also works for shared-memory clients
+{
+    std::string line;
+    if (client_socket >= 0 && client_socket < MAX_SHM_SOCKET && framed_clients[client_socket].load(std::memory_order_relaxed))
+    {
+        line.assign((const char *)data, len); // one send, so that a message from another thread cannot end up inside it
+        line += '\n';
+        data = line.data();
+        len = line.size();
+    }
+
+    ShmChannel *channel = shm_channel(client_socket);
+    if (!channel)
+        return send(client_socket, data, len, flags);
+
+    std::lock_guard<std::mutex> lock(channel->send_mutex);
+    for (int attempt = 0; !shm_ring_push(&channel->region->to_client, channel->to_client_doorbell, data, len); ++attempt)
+    {
+        if (attempt == SHM_SEND_RETRIES) // the client stopped reading
+            return -1;
+        usleep(100);
+    }
+    return len;
+}
+
+ssize_t recv_from_client(int client_socket, void *buffer, size_t len, int flags) // recv() that also works for shared-memory clients
+{
+    ShmChannel *channel = shm_channel(client_socket);
+    if (!channel)
+        return recv(client_socket, buffer, len, flags);
+
+    int bytes_received = shm_ring_pop(&channel->region->to_server, buffer, len);
+    return bytes_received < 0 ? 0 : bytes_received; // woken up with an empty ring means the client hung up
+}
+
+ShmChannel *attach_shm_channel(int client_socket, int memfd, int to_server_doorbell, int to_client_doorbell) // function to map a session's memory
+{
+    if (client_socket >= MAX_SHM_SOCKET)
+        return nullptr;
+    void *region = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (region == MAP_FAILED)
+        return nullptr;
+
+    ShmChannel *channel = new ShmChannel;
+    channel->memfd = memfd;
+    channel->to_server_doorbell = to_server_doorbell;
+    channel->to_client_doorbell = to_client_doorbell;
+    channel->region = (ShmRegion *)region;
+    shm_channels[client_socket].store(channel, std::memory_order_release);
+    return channel;
+}
+
+void close_client(int client_socket) // function to close a client's socket and its shared memory, if any
+{
+    set_framed(client_socket, false);
+    ShmChannel *channel = shm_channel(client_socket);
+    if (channel)
+    {
+        // Nobody else sends to this client any more: it was removed from the mappings before
+        shm_channels[client_socket].store(nullptr, std::memory_order_release);
+        munmap(channel->region, sizeof(ShmRegion));
+        close(channel->memfd);
+        close(channel->to_server_doorbell);
+        close(channel->to_client_doorbell);
+        delete channel;
+    }
+    close(client_socket);
+}
+
+// CPU pinning of client threads (--pin-cpus). A client thread runs on the CPU that received the
+// connection's packets (SO_INCOMING_CPU, i.e. where RSS/RPS steered the flow), so its socket
+// buffers, its stack and everything it allocates stay on that CPU's NUMA node (first touch).
+bool pin_cpus = false;
+std::vector<int> allowed_cpus;          // CPUs this process may run on
+std::unordered_map<int, int> cpu_node;  // CPU -> NUMA node
+std::atomic<unsigned> next_cpu{0};      // round robin fallback when the incoming CPU is unknown
+
+// State used for draining the server and handing it off to a new process
+std::atomic<bool> draining{false};              // set once a new server asked to take over
+int drain_pipe[2] = {-1, -1};                   // written once when draining starts, wakes every poll()
+int handoff_conn = -1;                          // connection to the new server process
+std::unordered_map<int, Session> parked_sessions; // sessions whose threads stopped for the handoff
+int active_handlers = 0;                        // number of running client threads
+std::mutex handoff_mutex;                       // a mutex to lock the above handoff state
+std::condition_variable handlers_cv;            // notified whenever a client thread ends
+
 bool authenticate(std::string username, std::string password) // function to authenticate the user
 {
     std::lock_guard<std::mutex> lock(users_mutex); // locking the users mapping
@@ -44,8 +205,8 @@ void add_client(int client_socket, std::string username) // function to add clie
         if (pair.second == username)
         {
             std::string response = "Error: You are already logged in from another terminal.";
-            send(client_socket, response.c_str(), response.size(), 0);
-            close(client_socket);
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
+            close_client(client_socket);
             return;
         }
     }
@@ -55,28 +216,121 @@ void add_client(int client_socket, std::string username) // function to add clie
 void welcome_msg(int client_socket) // function to send welcome message to the client
 {
     std::string welcome = "Welcome to the chat server!";
-    send(client_socket, welcome.c_str(), welcome.size(), 0);
+    send_to_client(client_socket, welcome.c_str(), welcome.size(), 0);
+}
+
+std::string presence_frame(const std::vector<std::string> &joined, const std::vector<std::string> &left, const std::string &recipient)
+{ // function to build one aggregated join/leave message, leaving out the recipient's own events
+    std::string frame;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const std::vector<std::string> &names = pass == 0 ? joined : left;
+        std::string list;
+        int count = 0;
+        for (const std::string &name : names)
+        {
+            if (name == recipient)
+                continue;
+            list += (count++ ? ", " : "") + name;
+        }
+        if (count == 0)
+            continue;
+        if (!frame.empty())
+            frame += " "; // no '\n', framed clients take that for the end of the message
+        frame += list + (count == 1 ? " has " : " have ") + (pass == 0 ? "joined" : "left") + " the chat.";
+    }
+    return frame;
 }
 
-void notify_others(int client_socket, std::string message) // function to notify other clients that a new client has joined
+void flush_presence() // function to send the pending join/leave events, one message per client
 {
+    std::vector<std::string> joined, left;
+    {
+        std::lock_guard<std::mutex> lock(presence_mutex);
+        for (const std::string &name : presence_order)
+        {
+            if (presence_net[name] > 0)
+                joined.push_back(name);
+            else if (presence_net[name] < 0)
+                left.push_back(name);
+        }
+        presence_order.clear();
+        presence_net.clear();
+    }
+    if (joined.empty() && left.empty())
+        return;
+
     std::lock_guard<std::mutex> lock(clients_mutex); // locking the clients mapping
     for (auto &pair : clients)
     {
-        if (pair.first != client_socket)
+        if (presence_opt_out.count(pair.first))
+            continue;
+        std::string frame = presence_frame(joined, left, pair.second);
+        if (!frame.empty())
+            send_to_client(pair.first, frame.c_str(), frame.size(), 0);
+    }
+}
+
+void notify_others(std::string username, bool joined) // function to notify other clients that a client has joined or left
+{
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(presence_mutex);
+        first = presence_order.empty();
+        if (!presence_net.count(username))
+            presence_order.push_back(username);
+        presence_net[username] += joined ? 1 : -1;
+    }
+
+    if (presence_debounce_ms == 0)
+        flush_presence();
+    else if (first)
+        presence_cv.notify_one();
+}
+
+void presence_loop() // thread function, sends the events of a window once it is over
+{
+    while (true)
+    {
         {
-            send(pair.first, message.c_str(), message.size(), 0);
+            std::unique_lock<std::mutex> lock(presence_mutex);
+            presence_cv.wait(lock, []
+                             { return !presence_order.empty() || draining; });
+            if (draining) // hand_off() sends the events that are still pending
+                return;
         }
+        std::this_thread::sleep_for(std::chrono::milliseconds(presence_debounce_ms));
+        flush_presence();
     }
 }
 
+void set_presence(int client_socket, std::string message) // function to opt in or out of join/leave notifications
+{
+    std::string setting = message.substr(10);
+    std::string response;
+    if (setting == "on" || setting == "off")
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        if (setting == "on")
+            presence_opt_out.erase(client_socket);
+        else
+            presence_opt_out.insert(client_socket);
+        response = "Presence notifications turned " + setting + ".";
+    }
+    else
+    {
+        response = "Error: Invalid format.";
+    }
+    send_to_client(client_socket, response.c_str(), response.size(), 0);
+}
+
 void broadcast(std::string username, int client_socket, std::string message) // function to broadcast message to all clients
 {
     std::string msg = message.substr(11);
     if (msg.empty()) // Error message if message is empty
     {
         std::string response = "Error: Message cannot be empty.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
 
@@ -89,7 +343,7 @@ void broadcast(std::string username, int client_socket, std::string message) //
         {
             continue;
         }
-        send(pair.first, formatted_msg.c_str(), formatted_msg.size(), 0);
+        send_to_client(pair.first, formatted_msg.c_str(), formatted_msg.size(), 0);
     }
 }
 
@@ -106,7 +360,7 @@ void private_msg(std::string username, int client_socket, std::string message) /
         if (msg.empty()) // Error message if message is empty
         {
             std::string response = "Error: Message cannot be empty.";
-            send(client_socket, response.c_str(), response.size(), 0);
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
             return;
         }
 
@@ -116,7 +370,7 @@ void private_msg(std::string username, int client_socket, std::string message) /
             if (pair.second == target_user)
             {
                 found = true;
-                send(pair.first, formatted_msg.c_str(), formatted_msg.size(), 0);
+                send_to_client(pair.first, formatted_msg.c_str(), formatted_msg.size(), 0);
                 break;
             }
         }
@@ -136,19 +390,19 @@ void private_msg(std::string username, int client_socket, std::string message) /
             if (exist == true)
             {
                 std::string response = "Error: User " + target_user + " is not online.";
-                send(client_socket, response.c_str(), response.size(), 0);
+                send_to_client(client_socket, response.c_str(), response.size(), 0);
             }
             else
             {
                 std::string response = "Error: User " + target_user + " doesnot exist.";
-                send(client_socket, response.c_str(), response.size(), 0);
+                send_to_client(client_socket, response.c_str(), response.size(), 0);
             }
         }
     }
     else
     {
         std::string response = "Error: Invalid Format.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
 }
@@ -161,25 +415,25 @@ void create_group(int client_socket, std::string message) // function to create
     if (group_name.empty()) // Error message if group name is empty
     {
         std::string response = "Error: Group name cannot be empty.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
     else if (group_name.find(' ') != std::string::npos) // Error message if group name contains space
     {
         std::string response = "Error: Group name cannot contain space.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
     else if (!groups.count(group_name)) // Create group if it doesn't exist
     {
         groups[group_name].insert(client_socket); // adding the client who created the group to the group
         std::string response = "Group " + group_name + " created.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
     }
     else // Error message if group already exists
     {
         std::string response = "Error: Group " + group_name + " already exists.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
     }
 }
 
@@ -191,13 +445,13 @@ void join_group(int client_socket, std::string message) // function to join a gr
     if (group_name.empty()) // Error message if group name is empty
     {
         std::string response = "Error: Group name cannot be empty.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
     else if (group_name.find(' ') != std::string::npos) // Error message if group name contains space
     {
         std::string response = "Error: Group name cannot contain space.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
     else if (groups.count(group_name))
@@ -205,12 +459,12 @@ void join_group(int client_socket, std::string message) // function to join a gr
         if (groups[group_name].count(client_socket)) // Error message if client is already a member of the group
         {
             std::string response = "Error: You are already a member of group " + group_name + ".";
-            send(client_socket, response.c_str(), response.size(), 0);
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
             return;
         }
         groups[group_name].insert(client_socket);
         std::string response = "You joined the group " + group_name + ".";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
 
         // This part of code is to informed other members of the group that a new member has joined the group
         // for (int sock : groups[group_name])
@@ -218,14 +472,14 @@ void join_group(int client_socket, std::string message) // function to join a gr
         //     if (sock != client_socket)
         //     {
         //         std::string join_msg = username + " has joined group " + group_name + ".";
-        //         send(sock, join_msg.c_str(), join_msg.size(), 0);
+        //         send_to_client(sock, join_msg.c_str(), join_msg.size(), 0);
         //     }
         // }
     }
     else // Error message if group doesn't exist
     {
         std::string response = "Error: Group " + group_name + " doesnot exist.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
     }
 }
 
@@ -237,13 +491,13 @@ void leave_group(int client_socket, std::string message) // function to leave a
     if (group_name.empty()) // Error message if group name is empty
     {
         std::string response = "Error: Group name cannot be empty.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
     else if (group_name.find(' ') != std::string::npos) // Error message if group name contains space
     {
         std::string response = "Error: Group name cannot contain space.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
         return;
     }
     else if (groups.count(group_name))
@@ -251,24 +505,24 @@ void leave_group(int client_socket, std::string message) // function to leave a
         if (!groups[group_name].count(client_socket)) // Error message if client is not a member of the group
         {
             std::string response = "Error: You are not a member of group " + group_name + ".";
-            send(client_socket, response.c_str(), response.size(), 0);
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
             return;
         }
         groups[group_name].erase(client_socket);
         std::string response = "You left the group " + group_name + ".";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
 
         // This part of code is to informed other members of the group that a member has left the group
         // for (int sock : groups[group_name])
         // {
         //     std::string leave_msg = username + " has left group " + group_name + ".";
-        //     send(sock, leave_msg.c_str(), leave_msg.size(), 0);
+        //     send_to_client(sock, leave_msg.c_str(), leave_msg.size(), 0);
         // }
     }
     else // Error message if group doesn't exist
     {
         std::string response = "Error: Group " + group_name + " does not exist.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
     }
 }
 
@@ -278,6 +532,7 @@ void cleanup(int client_socket) // function to cleanup the client
     {
         std::lock_guard<std::mutex> lock(clients_mutex);
         clients.erase(client_socket);
+        presence_opt_out.erase(client_socket);
     }
     // Removing client from groups mapping
     {
@@ -301,7 +556,7 @@ void group_msg(std::string username, int client_socket, std::string message) //
         if (msg.empty()) // Error message if message is empty
         {
             std::string response = "Error: Message cannot be empty.";
-            send(client_socket, response.c_str(), response.size(), 0);
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
             return;
         }
 
@@ -312,78 +567,178 @@ void group_msg(std::string username, int client_socket, std::string message) //
             {
                 if (sock != client_socket)
                 {
-                    send(sock, formatted_msg.c_str(), formatted_msg.size(), 0);
+                    send_to_client(sock, formatted_msg.c_str(), formatted_msg.size(), 0);
                 }
             }
         }
         else if (groups.count(group_name) && !groups[group_name].count(client_socket)) // Error message if client is not a member of the group
         {
             std::string response = "Error: You are not a member of group " + group_name + ".";
-            send(client_socket, response.c_str(), response.size(), 0);
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
         }
         else // Error message if group doesn't exist
         {
             std::string response = "Error: Group " + group_name + " does not exist.";
-            send(client_socket, response.c_str(), response.size(), 0);
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
         }
     }
     else // Error message if invalid format
     {
         std::string response = "Error: Invalid format.";
-        send(client_socket, response.c_str(), response.size(), 0);
+        send_to_client(client_socket, response.c_str(), response.size(), 0);
+    }
+}
+
+bool wait_for_data(int client_socket) // function to wait until the client sent something, returns false if the server is draining
+{
+    ShmChannel *channel = shm_channel(client_socket);
+    if (channel)
+    {
+        // The Unix socket of a shared-memory client only becomes readable when the client hangs up
+        pollfd extra[2];
+        extra[0] = {client_socket, POLLIN, 0};
+        extra[1] = {drain_pipe[0], POLLIN, 0};
+        bool message = !draining && shm_ring_wait(&channel->region->to_server, channel->to_server_doorbell, extra, 2);
+        if (draining)
+            return false; // pending messages stay in the ring for the new server
+        return message || extra[0].revents;
+    }
+
+    pollfd fds[2];
+    fds[0] = {client_socket, POLLIN, 0};
+    fds[1] = {drain_pipe[0], POLLIN, 0};
+    while (true)
+    {
+        if (draining)
+            return false;
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return true; // let recv() report the error
+        if (draining)
+            return false; // pending data stays in the socket for the new server
+        if (fds[0].revents)
+            return true;
     }
 }
 
-void handle_client(int client_socket) // function to handle each client (thread function)
+enum ReadResult
+{
+    COMMAND, // a command was read
+    CLOSED,  // the client hung up
+    PARKED   // the server is handing off, the new process continues this session
+};
+
+ReadResult read_command(int client_socket, Session &session, std::string &command) // function to get the next command of a client
 {
     char buffer[BUFFER_SIZE];
-    std::string username, password; // username and password of the client received from the client_socket
-
-    // Sending username prompt to cilent
-    std::string user_prompt = "Enter username: ";
-    send(client_socket, user_prompt.c_str(), user_prompt.size(), 0);
-    memset(buffer, 0, BUFFER_SIZE);
-    recv(client_socket, buffer, BUFFER_SIZE, 0);
-    username = std::string(buffer);
-    username = username.substr(0, username.find('\n'));
-
-    // Sending password prompt to client
-    std::string pass_prompt = "Enter password: ";
-    send(client_socket, pass_prompt.c_str(), pass_prompt.size(), 0);
-    memset(buffer, 0, BUFFER_SIZE);
-    recv(client_socket, buffer, BUFFER_SIZE, 0);
-    password = std::string(buffer);
-    password = password.substr(0, password.find('\n'));
-
-    // Authentication
-    bool authenticated = authenticate(username, password); // checking if the user is authenticated or not
-
-    if (!authenticated) // if not authenticated, send error message and close the client socket
-    {
-        std::string response = "Authentication failed.";
-        send(client_socket, response.c_str(), response.size(), 0);
-        close(client_socket);
-        return;
+    while (true)
+    {
+        size_t newline = session.pending.find('\n');
+        if (newline != std::string::npos) // commands that arrived together are handled one at a time
+        {
+            command = session.pending.substr(0, newline);
+            session.pending.erase(0, newline + 1);
+            return COMMAND;
+        }
+        if (session.pending.size() >= BUFFER_SIZE) // a line this long is taken as it is
+        {
+            command.swap(session.pending);
+            session.pending.clear();
+            return COMMAND;
+        }
+
+        if (!wait_for_data(client_socket))
+            return PARKED;
+        int bytes_received = recv_from_client(client_socket, buffer, BUFFER_SIZE, 0);
+        if (bytes_received <= 0)
+            return CLOSED;
+        session.pending.append(buffer, bytes_received);
+        if (session.framed)
+            continue;
+        if (session.pending.find('\n') == std::string::npos) // unframed client, the whole recv() is one command
+        {
+            command.swap(session.pending);
+            session.pending.clear();
+            return COMMAND;
+        }
+        session.framed = true;
+        set_framed(client_socket, true);
     }
+}
 
-    // Adding client after authentication
-    add_client(client_socket, username);
+void park_session(int client_socket, const Session &session) // function to stop handling a client without disconnecting it
+{
+    std::lock_guard<std::mutex> lock(handoff_mutex);
+    parked_sessions[client_socket] = session;
+}
 
-    // Welcome message
-    welcome_msg(client_socket);
+void handle_client(int client_socket, Session session) // function to handle each client, resumes at session.stage
+{
+    std::string message;
+    ReadResult result;
 
-    // Notify others that a new client has joined
-    notify_others(client_socket, username + " has joined the chat.");
+    if (session.stage == NEW)
+    {
+        // Sending username prompt to cilent
+        std::string user_prompt = "Enter username: ";
+        send_to_client(client_socket, user_prompt.c_str(), user_prompt.size(), 0);
+        session.stage = AWAIT_USERNAME;
+    }
+
+    if (session.stage == AWAIT_USERNAME)
+    {
+        result = read_command(client_socket, session, session.username);
+        if (result == PARKED)
+            return park_session(client_socket, session);
+        if (result == CLOSED)
+            return close_client(client_socket);
+
+        // Sending password prompt to client
+        std::string pass_prompt = "Enter password: ";
+        send_to_client(client_socket, pass_prompt.c_str(), pass_prompt.size(), 0);
+        session.stage = AWAIT_PASSWORD;
+    }
+
+    const std::string &username = session.username; // username of the client received from the client_socket
+
+    if (session.stage == AWAIT_PASSWORD)
+    {
+        std::string password;
+        result = read_command(client_socket, session, password);
+        if (result == PARKED)
+            return park_session(client_socket, session);
+        if (result == CLOSED)
+            return close_client(client_socket);
+
+        // Authentication
+        bool authenticated = authenticate(username, password); // checking if the user is authenticated or not
+
+        if (!authenticated) // if not authenticated, send error message and close the client socket
+        {
+            std::string response = "Authentication failed.";
+            send_to_client(client_socket, response.c_str(), response.size(), 0);
+            close_client(client_socket);
+            return;
+        }
+
+        // Adding client after authentication
+        add_client(client_socket, username);
+
+        // Welcome message
+        welcome_msg(client_socket);
+
+        // Notify others that a new client has joined
+        notify_others(username, true);
+        session.stage = LOGGED_IN;
+    }
 
     // Handling various commands/messages
     while (true)
     {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(client_socket, buffer, BUFFER_SIZE, 0);
-        if (bytes_received <= 0)
+        result = read_command(client_socket, session, message);
+        if (result == PARKED) // the server is handing off, the new process continues this session
+            return park_session(client_socket, session);
+        if (result == CLOSED)
             break;
-        std::string message(buffer, bytes_received);
-        message = message.substr(0, message.find('\n')); // Trim newline
 
         if (message.rfind("/broadcast ", 0) == 0) // Broadcast message to all clients
         {
@@ -409,6 +764,10 @@ void handle_client(int client_socket) // function to handle each client (thread
         {
             leave_group(client_socket, message);
         }
+        else if (message.rfind("/presence ", 0) == 0) // Turn join/leave notifications on or off
+        {
+            set_presence(client_socket, message);
+        }
         else if (message == "/exit") // Exit the chat or disconnect the client from the server
         {
             break;
@@ -416,7 +775,7 @@ void handle_client(int client_socket) // function to handle each client (thread
         else // Error message if invalid format i.e., no command is matched
         {
             std::string formatted_msg = "Error: Invalid format.";
-            send(client_socket, formatted_msg.c_str(), formatted_msg.size(), 0);
+            send_to_client(client_socket, formatted_msg.c_str(), formatted_msg.size(), 0);
         }
     }
 
@@ -424,10 +783,99 @@ void handle_client(int client_socket) // function to handle each client (thread
     cleanup(client_socket);
 
     // Notify others that a client has left
-    std::string leave_msg = username + " has left the chat.";
-    notify_others(client_socket, leave_msg);
+    notify_others(username, false);
 
-    close(client_socket);
+    close_client(client_socket);
+}
+
+std::vector<int> parse_cpu_list(const std::string &list) // function to parse a kernel CPU list such as "0-3,8-11"
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        size_t dash = range.find('-');
+        try
+        {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+    return cpus;
+}
+
+void load_cpu_topology() // function to find the usable CPUs and the NUMA node of each of them
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &set))
+            allowed_cpus.push_back(cpu);
+    }
+
+    for (int node = 0;; ++node)
+    {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file)
+            break;
+        std::string list;
+        std::getline(file, list);
+        for (int cpu : parse_cpu_list(list))
+            cpu_node[cpu] = node;
+    }
+}
+
+int pick_cpu(int client_socket) // function to choose the CPU a client thread runs on
+{
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(client_socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu >= 0)
+    {
+        for (int allowed : allowed_cpus)
+        {
+            if (allowed == cpu)
+                return cpu;
+        }
+    }
+    return allowed_cpus[next_cpu++ % allowed_cpus.size()];
+}
+
+void pin_to_cpu(int cpu) // function to pin the calling thread to one CPU
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cerr << "Failed to pin thread to CPU " << cpu << std::endl;
+}
+
+void client_thread(int client_socket, Session session, int cpu) // thread function, keeps count of running client threads
+{
+    if (cpu >= 0) // pinned before handle_client touches its buffers, so they are allocated on the local node
+        pin_to_cpu(cpu);
+    handle_client(client_socket, session);
+
+    std::lock_guard<std::mutex> lock(handoff_mutex);
+    --active_handlers;
+    handlers_cv.notify_all();
+}
+
+void start_client_thread(int client_socket, Session session) // function to spawn a detached thread for a client
+{
+    {
+        std::lock_guard<std::mutex> lock(handoff_mutex);
+        ++active_handlers;
+    }
+    int cpu = (pin_cpus && !allowed_cpus.empty()) ? pick_cpu(client_socket) : -1;
+    std::thread(client_thread, client_socket, session, cpu).detach();
 }
 
 int load_users() // function to load users from users.txt file
@@ -447,7 +895,9 @@ int load_users() // function to load users from users.txt file
         {
             std::string username = line.substr(0, colon);
             std::string password = line.substr(colon + 1);
-            users[username] = password.substr(0, password.length() - 1);
+            if (!password.empty() && password.back() == '\r') // users.txt may have Windows line endings
+                password.pop_back();
+            users[username] = password;
         }
     }
     file.close();
@@ -495,31 +945,375 @@ int create_server_socket()
     return server_socket;
 }
 
+int create_unix_listener(const std::string &path, int type) // function to listen on a Unix socket path, returns -1 on failure
+{
+    int listener = socket(AF_UNIX, type, 0);
+    if (listener < 0)
+    {
+        std::cerr << "Unix socket creation failed" << std::endl;
+        return -1;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 5) < 0)
+    {
+        std::cerr << "Bind failed on " << path << std::endl;
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+bool open_shm_session(int conn) // function to create the shared memory of a new session and pass it to the client
+{
+    int memfd = memfd_create("chat_shm", 0);
+    int to_server_doorbell = eventfd(0, EFD_NONBLOCK);
+    int to_client_doorbell = eventfd(0, EFD_NONBLOCK);
+    ShmChannel *channel = nullptr;
+    if (memfd >= 0 && to_server_doorbell >= 0 && to_client_doorbell >= 0 && ftruncate(memfd, sizeof(ShmRegion)) == 0)
+        channel = attach_shm_channel(conn, memfd, to_server_doorbell, to_client_doorbell);
+
+    if (channel && send_record(conn, "SHM", {memfd, to_server_doorbell, to_client_doorbell}))
+        return true;
+
+    std::cerr << "Shared-memory session setup failed" << std::endl;
+    if (channel)
+    {
+        close_client(conn);
+        return false;
+    }
+    for (int fd : {memfd, to_server_doorbell, to_client_doorbell, conn})
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+    return false;
+}
+
 void accept_clients(int server_socket)
 {
+    pollfd fds[4];
+    fds[0] = {server_socket, POLLIN, 0};
+    fds[1] = {unix_socket, POLLIN, 0}; // poll() skips negative descriptors of disabled listeners
+    fds[2] = {shm_socket, POLLIN, 0};
+    fds[3] = {drain_pipe[0], POLLIN, 0};
     while (true)
     {
-        sockaddr_in client_addr{};
-        socklen_t client_len = sizeof(client_addr);
-        int client_socket = accept(server_socket, (sockaddr *)&client_addr, &client_len); // accepting client socket
-        if (client_socket < 0)                                                            // prompting error when accept fails
-        {
-            std::cerr << "Accept failed" << std::endl;
+        if (poll(fds, 4, -1) < 0)
             continue;
+        if (draining) // stop accepting, the new server accepts on the same listening sockets from now on
+            return;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            if (!fds[i].revents)
+                continue;
+            int client_socket = accept(fds[i].fd, nullptr, nullptr); // accepting client socket
+            if (client_socket < 0)                                  // prompting error when accept fails
+            {
+                std::cerr << "Accept failed" << std::endl;
+                continue;
+            }
+            if (fds[i].fd == shm_socket && !open_shm_session(client_socket))
+                continue;
+
+            start_client_thread(client_socket, Session{}); // creating a thread for each client
+        }
+    }
+}
+
+// Handoff protocol: the old server sends SOCK_SEQPACKET records over a Unix socket, some of them
+// carrying a file descriptor (SCM_RIGHTS):
+//   "LISTEN <tcp|unix|shm>"                          + listening socket
+//   "CLIENT <stage> <presence> <framed> <username>"  + client socket, clients are numbered in the order they are sent
+//   "PENDING <client> <data>"                        start of a framed command still waiting for its '\n'
+//   "SHM <client>"                                   + memfd and doorbells of a shared-memory client
+//   "GROUP <name> <client>..."                       group members given by client number, large groups take several records
+//   "END"
+void wait_for_handoff(int handoff_socket, std::string handoff_path) // thread function, starts draining once a new server connects
+{
+    int conn = accept(handoff_socket, nullptr, nullptr);
+    close(handoff_socket);
+    unlink(handoff_path.c_str()); // the new server can listen for the next handoff on the same path
+    if (conn < 0)
+    {
+        std::cerr << "Handoff accept failed" << std::endl;
+        return;
+    }
+
+    std::cout << "New server connected, draining..." << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(handoff_mutex);
+        handoff_conn = conn;
+    }
+    {
+        std::lock_guard<std::mutex> lock(presence_mutex);
+        draining = true;
+    }
+    presence_cv.notify_all();
+    if (write(drain_pipe[1], "x", 1) < 0) // the pipe is never read, so every poll() on it returns from now on
+        std::cerr << "Failed to wake client threads" << std::endl;
+}
+
+int listen_for_handoff(const std::string &handoff_path) // function to start listening for a new server on a Unix socket
+{
+    int handoff_socket = create_unix_listener(handoff_path, SOCK_SEQPACKET);
+    if (handoff_socket < 0)
+        return 1;
+
+    std::thread(wait_for_handoff, handoff_socket, handoff_path).detach();
+    std::cout << "Accepting handoff on " << handoff_path << std::endl;
+    return 0;
+}
+
+void hand_off(int server_socket) // function to pass the listening socket and all sessions to the new server
+{
+    std::unique_lock<std::mutex> lock(handoff_mutex);
+    // Every client thread finishes the command it is processing (including its sends) and parks
+    handlers_cv.wait(lock, []
+                     { return active_handlers == 0; });
+
+    flush_presence(); // events of the current window are sent before the clients move
+
+    send_record(handoff_conn, "LISTEN tcp", {server_socket});
+    if (unix_socket >= 0)
+        send_record(handoff_conn, "LISTEN unix", {unix_socket});
+    if (shm_socket >= 0)
+        send_record(handoff_conn, "LISTEN shm", {shm_socket});
+
+    std::unordered_map<int, int> client_index; // client socket -> number in the handoff
+    {
+        std::lock_guard<std::mutex> clients_lock(clients_mutex);
+        for (auto &pair : parked_sessions)
+        {
+            int index = client_index.size();
+            client_index[pair.first] = index;
+            std::string presence = presence_opt_out.count(pair.first) ? "0" : "1";
+            std::string framed = pair.second.framed ? "1" : "0";
+            send_record(handoff_conn, "CLIENT " + std::to_string(pair.second.stage) + " " + presence + " " + framed + " " + pair.second.username, {pair.first});
+            if (!pair.second.pending.empty()) // never contains a '\n', read_command() takes complete lines out
+                send_record(handoff_conn, "PENDING " + std::to_string(index) + " " + pair.second.pending, {});
+
+            ShmChannel *channel = shm_channel(pair.first);
+            if (channel)
+                send_record(handoff_conn, "SHM " + std::to_string(index), {channel->memfd, channel->to_server_doorbell, channel->to_client_doorbell});
+        }
+    }
+    {
+        std::lock_guard<std::mutex> groups_lock(groups_mutex);
+        for (auto &group : groups)
+        {
+            std::string record = "GROUP " + group.first;
+            int members = 0;
+            for (int sock : group.second)
+            {
+                if (!client_index.count(sock))
+                    continue;
+                record += " " + std::to_string(client_index[sock]);
+                if (++members % GROUP_RECORD_MEMBERS == 0) // keep records well below MAX_RECORD_SIZE
+                {
+                    send_record(handoff_conn, record, {});
+                    record = "GROUP " + group.first;
+                }
+            }
+            if (members == 0 || members % GROUP_RECORD_MEMBERS != 0)
+                send_record(handoff_conn, record, {});
         }
+    }
+    send_record(handoff_conn, "END", {});
+
+    std::cout << "Handed off " << parked_sessions.size() << " connections." << std::endl;
+    for (auto &pair : parked_sessions) // the new server holds its own copies of the sockets
+        close_client(pair.first);
+    close(handoff_conn);
+}
+
+int take_over(const std::string &handoff_path) // function to receive the listening socket and sessions from a running server
+{
+    int conn = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, handoff_path.c_str(), sizeof(addr.sun_path) - 1);
+    if (conn < 0 || connect(conn, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::cerr << "Could not connect to the running server on " << handoff_path << std::endl;
+        return -1;
+    }
 
-        std::thread(handle_client, client_socket).detach(); // creating a thread for each client
+    int server_socket = -1;
+    std::vector<std::pair<int, Session>> sessions;
+    std::unordered_set<int> opted_out;
+    std::string record;
+    std::vector<int> fds;
+    while (recv_record(conn, record, fds) && record != "END")
+    {
+        std::istringstream in(record);
+        std::string kind;
+        in >> kind;
+        int fd = fds.empty() ? -1 : fds[0];
+        if (kind == "LISTEN")
+        {
+            std::string listener;
+            in >> listener;
+            if (listener == "tcp")
+                server_socket = fd;
+            else if (listener == "unix")
+                unix_socket = fd;
+            else if (listener == "shm")
+                shm_socket = fd;
+        }
+        else if (kind == "CLIENT")
+        {
+            int stage, presence, framed;
+            Session session;
+            in >> stage >> presence >> framed;
+            in.get();
+            std::getline(in, session.username);
+            session.stage = (SessionStage)stage;
+            session.framed = framed;
+            sessions.push_back({fd, session});
+            if (!presence)
+                opted_out.insert(fd);
+        }
+        else if (kind == "PENDING")
+        {
+            size_t index;
+            in >> index;
+            in.get();
+            if (index < sessions.size())
+                std::getline(in, sessions[index].second.pending);
+        }
+        else if (kind == "SHM")
+        {
+            size_t index;
+            in >> index;
+            if (fds.size() != 3 || index >= sessions.size() ||
+                !attach_shm_channel(sessions[index].first, fds[0], fds[1], fds[2]))
+            {
+                std::cerr << "Failed to take over a shared-memory session" << std::endl;
+                return -1;
+            }
+        }
+        else if (kind == "GROUP")
+        {
+            std::string group_name;
+            size_t index;
+            in >> group_name;
+            std::lock_guard<std::mutex> lock(groups_mutex);
+            auto &members = groups[group_name];
+            while (in >> index)
+            {
+                if (index < sessions.size())
+                    members.insert(sessions[index].first);
+            }
+        }
     }
+    close(conn);
+
+    if (record != "END" || server_socket < 0)
+    {
+        std::cerr << "Handoff from " << handoff_path << " did not complete" << std::endl;
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (auto &pair : sessions)
+        {
+            if (pair.second.stage == LOGGED_IN)
+                clients[pair.first] = pair.second.username;
+        }
+        presence_opt_out = opted_out;
+    }
+    for (auto &pair : sessions)
+    {
+        set_framed(pair.first, pair.second.framed);
+        start_client_thread(pair.first, pair.second);
+    }
+
+    std::cout << "Took over " << sessions.size() << " connections :-)" << std::endl;
+    std::cout << "Server listening on port " << PORT << std::endl;
+    return server_socket;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    std::string handoff_path, takeover_path, unix_path, shm_path;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--handoff" && i + 1 < argc) // accept a future takeover on this Unix socket
+            handoff_path = argv[++i];
+        else if (arg == "--takeover" && i + 1 < argc) // take over from the server accepting handoffs on this Unix socket
+            takeover_path = argv[++i];
+        else if (arg == "--unix" && i + 1 < argc) // also accept clients on this Unix socket
+            unix_path = argv[++i];
+        else if (arg == "--shm" && i + 1 < argc) // also accept shared-memory clients, set up over this Unix socket
+            shm_path = argv[++i];
+        else if (arg == "--pin-cpus") // pin every client thread to the CPU its connection arrives on
+            pin_cpus = true;
+        else if (arg == "--presence-debounce" && i + 1 < argc) // window in ms over which join/leave events are batched
+            presence_debounce_ms = std::max(0, std::atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--handoff <unix_path>] [--takeover <unix_path>] [--unix <unix_path>] [--shm <unix_path>] [--presence-debounce <ms>] [--pin-cpus]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (pipe(drain_pipe) < 0)
+    {
+        std::cerr << "Pipe creation failed" << std::endl;
+        return 1;
+    }
+
     load_users(); // loading users from users.txt file
 
-    int server_socket = create_server_socket(); // creating server socket
+    if (pin_cpus)
+    {
+        load_cpu_topology();
+        std::unordered_set<int> nodes;
+        for (int cpu : allowed_cpus)
+            nodes.insert(cpu_node.count(cpu) ? cpu_node[cpu] : 0);
+        std::cout << "Pinning client threads to " << allowed_cpus.size() << " CPUs on " << nodes.size() << " NUMA node(s)" << std::endl;
+    }
 
-    accept_clients(server_socket); // accepting clients
+    int server_socket;
+    if (takeover_path.empty())
+        server_socket = create_server_socket(); // creating server socket
+    else if ((server_socket = take_over(takeover_path)) < 0)
+        return 1;
+
+    // Listeners handed over by the old server are kept, the others are created here
+    if (!unix_path.empty() && unix_socket < 0)
+    {
+        if ((unix_socket = create_unix_listener(unix_path, SOCK_STREAM)) < 0)
+            return 1;
+        std::cout << "Server listening on " << unix_path << std::endl;
+    }
+    if (!shm_path.empty() && shm_socket < 0)
+    {
+        if ((shm_socket = create_unix_listener(shm_path, SOCK_SEQPACKET)) < 0)
+            return 1;
+        std::cout << "Shared-memory sessions on " << shm_path << std::endl;
+    }
+
+    if (!handoff_path.empty() && listen_for_handoff(handoff_path) != 0)
+        return 1;
+
+    std::thread presence_thread;
+    if (presence_debounce_ms > 0)
+        presence_thread = std::thread(presence_loop); // sending batched join/leave notifications
+
+    accept_clients(server_socket); // accepting clients, returns only when a new server takes over
+
+    hand_off(server_socket); // passing the listening socket and the clients to the new server
+    if (presence_thread.joinable())
+        presence_thread.join();
 
     close(server_socket); // closing the server socket
     return 0;
-}
\ No newline at end of file
+}
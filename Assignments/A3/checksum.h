@@ -0,0 +1,159 @@
+// Internet checksums (RFC 1071) for the packets server.cpp and client.cpp build by hand.
+//
+// With IP_HDRINCL the kernel fills in the IP header checksum but never the TCP one, so packets
+// sent with tcp->check = 0 are dropped by any real TCP stack. The ones-complement sum is computed
+// with AVX2 or SSE2 when the CPU has it (picked at run time) and a scalar loop otherwise. Packets
+// built from a template only change a few fields, so their checksums can be updated incrementally
+// (RFC 1624) instead of being summed again.
+//
+// The sum is taken over 16-bit words in host byte order: the ones-complement sum is byte-order
+// independent (RFC 1071, section 2), so the folded result can be stored into the header as is.
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <immintrin.h>
+
+#define CSUM_FLUSH_BLOCKS 16384  // SIMD blocks summed in 32-bit lanes before they could overflow
+#define CSUM_SIMD_MIN 128  // Shorter buffers (bare headers) are summed faster by the scalar loop
+
+// Adds len bytes to a 64-bit accumulator, 32 bits at a time. An odd last byte is padded with zero.
+inline uint64_t csum_add_scalar(const unsigned char *data, size_t len, uint64_t sum) {
+    while (len >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        sum += word;
+        data += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t word;
+        memcpy(&word, data, 2);
+        sum += word;
+        data += 2;
+        len -= 2;
+    }
+    if (len) {
+        uint16_t word = 0;
+        memcpy(&word, data, 1);
+        sum += word;
+    }
+    return sum;
+}
+
+// 16-bit words are zero-extended into 32-bit lanes; the lanes are moved into the 64-bit sum
+// every CSUM_FLUSH_BLOCKS blocks, long before 65536 additions of 0xffff could overflow them.
+__attribute__((target("sse2")))
+inline uint64_t csum_add_sse2(const unsigned char *data, size_t len, uint64_t sum) {
+    const __m128i zero = _mm_setzero_si128();
+    while (len >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        for (int block = 0; block < CSUM_FLUSH_BLOCKS && len >= 16; ++block, data += 16, len -= 16) {
+            __m128i words = _mm_loadu_si128((const __m128i *)data);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(words, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(words, zero));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    return csum_add_scalar(data, len, sum);
+}
+
+__attribute__((target("avx2")))
+inline uint64_t csum_add_avx2(const unsigned char *data, size_t len, uint64_t sum) {
+    const __m256i zero = _mm256_setzero_si256();
+    while (len >= 32) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int block = 0; block < CSUM_FLUSH_BLOCKS && len >= 32; ++block, data += 32, len -= 32) {
+            __m256i words = _mm256_loadu_si256((const __m256i *)data);
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(words, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(words, zero));
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i *)lanes, acc);
+        for (uint32_t lane : lanes)
+            sum += lane;
+    }
+    return csum_add_sse2(data, len, sum);
+}
+
+typedef uint64_t (*CsumAddFn)(const unsigned char *, size_t, uint64_t);
+
+// The widest implementation the CPU supports, looked up once.
+inline CsumAddFn csum_add_impl() {
+    static const CsumAddFn impl = __builtin_cpu_supports("avx2") ? csum_add_avx2
+                                  : __builtin_cpu_supports("sse2") ? csum_add_sse2
+                                                                   : csum_add_scalar;
+    return impl;
+}
+
+inline uint64_t csum_add(const void *data, size_t len, uint64_t sum = 0) {
+    if (len < CSUM_SIMD_MIN)
+        return csum_add_scalar((const unsigned char *)data, len, sum);
+    return csum_add_impl()((const unsigned char *)data, len, sum);
+}
+
+// Folds the accumulator to 16 bits and complements it: the value that goes into the header.
+inline uint16_t csum_fold(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+// Sum of the TCP pseudo header: source and destination address, protocol and TCP length.
+inline uint64_t tcp_pseudo_sum(const struct iphdr *ip, size_t tcp_len) {
+    uint64_t sum = (uint64_t)ip->saddr + ip->daddr;
+    sum += htons(IPPROTO_TCP);
+    sum += htons((uint16_t)tcp_len);
+    return sum;
+}
+
+// Fills in the IP header checksum.
+inline void set_ip_checksum(struct iphdr *ip) {
+    ip->check = 0;
+    ip->check = csum_fold(csum_add(ip, ip->ihl * 4));
+}
+
+// Fills in the TCP checksum of a segment of tcp_len bytes (header, options and payload).
+inline void set_tcp_checksum(const struct iphdr *ip, struct tcphdr *tcp, size_t tcp_len) {
+    tcp->check = 0;
+    tcp->check = csum_fold(csum_add(tcp, tcp_len, tcp_pseudo_sum(ip, tcp_len)));
+}
+
+// A header with a correct checksum sums to 0xffff (its fold is 0).
+inline bool ip_checksum_ok(const struct iphdr *ip) {
+    return csum_fold(csum_add(ip, ip->ihl * 4)) == 0;
+}
+
+inline bool tcp_checksum_ok(const struct iphdr *ip, const struct tcphdr *tcp, size_t tcp_len) {
+    return csum_fold(csum_add(tcp, tcp_len, tcp_pseudo_sum(ip, tcp_len))) == 0;
+}
+
+// RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m'), when a 16-bit field changes from m to m'.
+// The values are in the byte order they have in the packet, like the checksum.
+inline uint16_t csum_update16(uint16_t check, uint16_t old_value, uint16_t new_value) {
+    uint32_t sum = (uint16_t)~check + (uint32_t)(uint16_t)~old_value + new_value;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+// Same for a 32-bit field (an address or a sequence number): its two 16-bit halves, folded once.
+inline uint16_t csum_update32(uint16_t check, uint32_t old_value, uint32_t new_value) {
+    uint64_t sum = (uint16_t)~check + (uint64_t)~old_value + new_value;
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+#endif
@@ -0,0 +1,173 @@
+// Checks the checksum implementations of checksum.h against each other and a plain 16-bit loop,
+// checks incremental updates against full recomputation, and measures the throughput of each.
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "checksum.h"
+
+using namespace std;
+
+// Textbook RFC 1071 loop, 16 bits at a time.
+uint16_t reference_checksum(const unsigned char *data, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        uint16_t word;
+        memcpy(&word, data + i, 2);
+        sum += word;
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    if (len & 1) {
+        uint16_t word = 0;
+        memcpy(&word, data + len - 1, 1);
+        sum += word;
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+bool check_implementations(mt19937 &rng) {
+    vector<unsigned char> buffer(1 << 20);
+    for (unsigned char &byte : buffer)
+        byte = rng();
+    vector<size_t> lengths = {0, 1, 2, 3, 15, 16, 17, 31, 32, 33, 40, 60, 1500, 9000, 65535, (size_t)1 << 20};
+    for (int i = 0; i < 2000; ++i)
+        lengths.push_back(rng() % 4096);
+
+    for (size_t len : lengths) {
+        size_t offset = rng() % 8;  // unaligned starts too
+        if (offset + len > buffer.size())
+            offset = 0;
+        const unsigned char *data = buffer.data() + offset;
+        uint16_t expected = reference_checksum(data, len);
+        if (csum_fold(csum_add_scalar(data, len, 0)) != expected ||
+            csum_fold(csum_add_sse2(data, len, 0)) != expected ||
+            (__builtin_cpu_supports("avx2") && csum_fold(csum_add_avx2(data, len, 0)) != expected)) {
+            cout << "[-] checksum mismatch for length " << len << endl;
+            return false;
+        }
+    }
+    // All ones is the worst case for the 32-bit lanes
+    vector<unsigned char> ones(4 << 20, 0xff);
+    uint16_t expected = reference_checksum(ones.data(), ones.size());
+    if (csum_fold(csum_add_sse2(ones.data(), ones.size(), 0)) != expected ||
+        (__builtin_cpu_supports("avx2") && csum_fold(csum_add_avx2(ones.data(), ones.size(), 0)) != expected)) {
+        cout << "[-] checksum mismatch on a buffer of 0xff" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool check_incremental(mt19937 &rng) {
+    unsigned char packet[sizeof(struct iphdr) + sizeof(struct tcphdr)] = {};
+    struct iphdr *ip = (struct iphdr *)packet;
+    struct tcphdr *tcp = (struct tcphdr *)(packet + sizeof(struct iphdr));
+    ip->ihl = 5;
+    ip->version = 4;
+    ip->tot_len = htons(sizeof(packet));
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_TCP;
+    tcp->doff = 5;
+    tcp->syn = 1;
+    set_ip_checksum(ip);
+    set_tcp_checksum(ip, tcp, sizeof(struct tcphdr));
+
+    for (int i = 0; i < 100000; ++i) {
+        uint32_t saddr = rng(), seq = rng();
+        uint16_t port = rng();
+        ip->check = csum_update32(ip->check, ip->saddr, saddr);
+        tcp->check = csum_update32(tcp->check, ip->saddr, saddr);  // the address is in the pseudo header
+        tcp->check = csum_update16(tcp->check, tcp->source, port);
+        tcp->check = csum_update32(tcp->check, tcp->seq, seq);
+        ip->saddr = saddr;
+        tcp->source = port;
+        tcp->seq = seq;
+        if (!ip_checksum_ok(ip) || !tcp_checksum_ok(ip, tcp, sizeof(struct tcphdr))) {
+            cout << "[-] incremental update gave a wrong checksum" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void measure(const char *name, CsumAddFn fn, size_t len, size_t total) {
+    vector<unsigned char> buffer(len, 0x5a);
+    size_t rounds = total / len;
+    uint64_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        buffer[i % len] = (unsigned char)i;  // keep the compiler from hoisting the sum out of the loop
+        sink += csum_fold(fn(buffer.data(), len, 0));
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("    %-7s %6zu bytes: %6.2f GB/s  %7.1f ns/packet  (%llu)\n", name, len, rounds * len / seconds / 1e9,
+           seconds * 1e9 / rounds, (unsigned long long)(sink & 1));
+}
+
+int main() {
+    mt19937 rng(42);
+    if (!check_implementations(rng) || !check_incremental(rng))
+        return 1;
+    cout << "[+] scalar, SSE2" << (__builtin_cpu_supports("avx2") ? ", AVX2" : "")
+         << " and incremental checksums agree with the reference" << endl;
+
+    for (size_t len : {40, 128, 1500, 65536}) {
+        measure("scalar", csum_add_scalar, len, (size_t)1 << 30);
+        measure("sse2", csum_add_sse2, len, (size_t)1 << 30);
+        if (__builtin_cpu_supports("avx2"))
+            measure("avx2", csum_add_avx2, len, (size_t)1 << 30);
+    }
+
+    // Patching a template's checksum vs summing the 40-byte packet again
+    unsigned char packet[sizeof(struct iphdr) + sizeof(struct tcphdr)] = {};
+    struct iphdr *ip = (struct iphdr *)packet;
+    struct tcphdr *tcp = (struct tcphdr *)(packet + sizeof(struct iphdr));
+    ip->ihl = 5;
+    vector<uint16_t> ports(4096);
+    vector<uint32_t> seqs(4096);
+    for (size_t i = 0; i < ports.size(); ++i) {
+        ports[i] = rng();
+        seqs[i] = rng();
+    }
+    volatile uint16_t sink;
+    const int rounds = 10000000;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        uint16_t port = ports[i & 4095];
+        uint32_t seq = seqs[i & 4095];
+        tcp->check = csum_update16(tcp->check, tcp->source, port);
+        tcp->check = csum_update32(tcp->check, tcp->seq, seq);
+        tcp->source = port;
+        tcp->seq = seq;
+        sink = tcp->check;
+    }
+    double incremental = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        tcp->source = ports[i & 4095];
+        tcp->seq = seqs[i & 4095];
+        set_tcp_checksum(ip, tcp, sizeof(struct tcphdr));
+        sink = tcp->check;
+    }
+    double full = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // The incremental update costs the same whatever the size of the segment, a full sum doesn't
+    vector<unsigned char> segment(sizeof(struct iphdr) + sizeof(struct tcphdr) + 1460, 0x5a);
+    ip = (struct iphdr *)segment.data();
+    tcp = (struct tcphdr *)(segment.data() + sizeof(struct iphdr));
+    ip->ihl = 5;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        tcp->source = ports[i & 4095];
+        tcp->seq = seqs[i & 4095];
+        set_tcp_checksum(ip, tcp, segment.size() - sizeof(struct iphdr));
+        sink = tcp->check;
+    }
+    double full_segment = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    (void)sink;
+    printf("    port + seq change: incremental %.1f ns, full TCP checksum %.1f ns (20-byte header), %.1f ns (1460-byte payload)\n",
+           incremental * 1e9 / rounds, full * 1e9 / rounds, full_segment * 1e9 / rounds);
+    return 0;
+}
@@ -2,31 +2,89 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <climits>
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <poll.h>
+#include <time.h>
 #include <sys/socket.h>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include "packet_filter.h"
+#include "packet.h"
+#include "congestion.h"
+#include "netem.h"
+#include "pcap_log.h"
 
 // Global definitions matching the assignment and the server's expectations.
 #define SERVER_PORT 12345
 #define CLIENT_SYN_SEQ 200
 #define CLIENT_FINAL_ACK_SEQ 600
-#define PACKET_SIZE (sizeof(struct iphdr) + sizeof(struct tcphdr))
+#define CLIENT_MSS 1460
+#define CLIENT_WSCALE 7
+#define CLIENT_WINDOW 65535
+#define DEFAULT_MSS 536             // MSS assumed when the SYN-ACK has none (RFC 9293)
+#define MAX_PACKET_SIZE (packet::IP_HEADER_LEN + packet::TCP_HEADER_LEN + packet::TCP_MAX_OPTIONS_LEN)
+#define LOAD_FIRST_ADDR "127.0.0.1" // the load generator's source addresses start here
+#define LOAD_FIRST_PORT 1024        // and its source ports sweep 1024-65535
+#define LOAD_PORT_COUNT (65536 - LOAD_FIRST_PORT)
+#define LOAD_RCVBUF_SIZE (8 << 20)  // room for the SYN-ACKs of a full window
+#define TRANSFER_FIRST_PORT 32768   // the bulk transfer picks its source port at random from here
+#define RTO_INITIAL_US 1000000      // retransmission timeout before the first RTT sample (RFC 6298)
+#define RTO_MIN_US 200000           // lower bound of the timeout, as in Linux (RFC 6298 asks for 1 s)
+#define RTO_MAX_US 60000000
+#define DUPACK_THRESHOLD 3          // duplicate ACKs that trigger a fast retransmit
+#define SYN_RETRIES 3
+#define KERNEL_PORT 12346           // port of the kernel TCP receiver the transfer is compared with
+#define KERNEL_CHUNK (256 << 10)    // bytes per write() / read() of the kernel transfer
+#define PACING_SLACK_NS 1000000     // a paced sender that woke up late may catch up on this much time
 // Although the server sends a SYN-ACK with sequence 400, we capture the value during the handshake.
 
 using namespace std;
 
+// Every packet sent or received is logged here with --pcap. Only the main thread sends and receives
+// on the raw sockets, as PacketLog requires.
+unique_ptr<PacketLog> capture;
+
 // Function to print TCP flags in a style similar to the server's output.
-void print_tcp_flags(struct tcphdr *tcp)
+void print_tcp_flags(const packet::TcpView &tcp)
 {
     cout << "[+] TCP Flags:  "
-         << "SYN: " << (int)tcp->syn
-         << " ACK: " << (int)tcp->ack
-         << " FIN: " << (int)tcp->fin
-         << " RST: " << (int)tcp->rst
-         << " PSH: " << (int)tcp->psh
-         << " SEQ: " << ntohl(tcp->seq) << endl;
+         << "SYN: " << tcp.has(packet::SYN)
+         << " ACK: " << tcp.has(packet::ACK)
+         << " FIN: " << tcp.has(packet::FIN)
+         << " RST: " << tcp.has(packet::RST)
+         << " PSH: " << tcp.has(packet::PSH)
+         << " SEQ: " << tcp.seq() << endl;
+}
+
+// Prints the TCP options of a segment, if it has any.
+void print_tcp_options(const packet::TcpOptions &options)
+{
+    if (!options.mss && options.wscale < 0 && !options.sack_permitted && !options.timestamps)
+        return;
+    cout << "[+] TCP Options:";
+    if (options.mss)
+        cout << " MSS " << options.mss;
+    if (options.wscale >= 0)
+        cout << "  window scale " << (int)options.wscale;
+    if (options.sack_permitted)
+        cout << "  SACK permitted";
+    if (options.timestamps)
+        cout << "  timestamps " << options.ts_val << "/" << options.ts_ecr;
+    cout << endl;
+}
+
+uint32_t timestamp_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
 }
 
 // Create a raw socket with IP_HDRINCL enabled.
@@ -47,130 +105,105 @@ int create_raw_socket()
     return sock;
 }
 
-// Constructs and sends an SYN packet.
-void send_syn(int sock, const char *client_ip, int client_port, const char *server_ip)
+// Sends a packet built in place by build_segment().
+void send_packet(int sock, const uint8_t *packet, size_t len, const char *server_ip, const char *what)
 {
-    char packet[PACKET_SIZE];
-    memset(packet, 0, PACKET_SIZE);
-
-    // IP and TCP header pointers.
-    struct iphdr *ip = (struct iphdr *)packet;
-    struct tcphdr *tcp = (struct tcphdr *)(packet + sizeof(struct iphdr));
-
-    // Filling IP header.
-    ip->ihl = 5;
-    ip->version = 4;
-    ip->tos = 0;
-    ip->tot_len = htons(PACKET_SIZE);
-    ip->id = htons(54321);
-    ip->frag_off = 0;
-    ip->ttl = 64;
-    ip->protocol = IPPROTO_TCP;
-    ip->saddr = inet_addr(client_ip);
-    ip->daddr = inet_addr(server_ip);
-
-    // TCP header for the SYN.
-    tcp->source = htons(client_port);
-    tcp->dest = htons(SERVER_PORT);
-    tcp->seq = htonl(CLIENT_SYN_SEQ);
-    tcp->ack_seq = 0;
-    tcp->doff = sizeof(struct tcphdr) / 4;
-    tcp->syn = 1;
-    tcp->ack = 0;
-    tcp->fin = 0;
-    tcp->rst = 0;
-    tcp->psh = 0;
-    tcp->window = htons(8192);
-    tcp->check = 0; // Kernel may compute checksum.
-
-    // Prepare destination structure.
     struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
     dest_addr.sin_family = AF_INET;
     dest_addr.sin_port = htons(SERVER_PORT);
     dest_addr.sin_addr.s_addr = inet_addr(server_ip);
 
-    cout << "[+] Client sending SYN..." << endl;
-    // Print the TCP header flags (matches server's debug style).
-    print_tcp_flags(tcp);
-
-    if (sendto(sock, packet, PACKET_SIZE, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0)
+    if (sendto(sock, packet, len, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0)
     {
-        perror("sendto() failed for SYN packet");
+        string message = string("sendto() failed for ") + what;
+        perror(message.c_str());
     }
     else
     {
-        cout << "[+] SYN sent" << endl;
+        if (capture)
+            capture->log(packet, len);
+        cout << "[+] " << what << " sent" << endl;
     }
 }
 
-// Constructs and sends the final ACK packet (client’s ACK to complete the handshake).
-void send_final_ack(int sock, const char *client_ip, int client_port, const char *server_ip, uint32_t server_seq)
-{
-    char packet[PACKET_SIZE];
-    memset(packet, 0, PACKET_SIZE);
-
-    // IP and TCP header pointers.
-    struct iphdr *ip = (struct iphdr *)packet;
-    struct tcphdr *tcp = (struct tcphdr *)(packet + sizeof(struct iphdr));
-
-    // Filling IP header.
-    ip->ihl = 5;
-    ip->version = 4;
-    ip->tos = 0;
-    ip->tot_len = htons(PACKET_SIZE);
-    ip->id = htons(54321);
-    ip->frag_off = 0;
-    ip->ttl = 64;
-    ip->protocol = IPPROTO_TCP;
-    ip->saddr = inet_addr(client_ip);
-    ip->daddr = inet_addr(server_ip);
-
-    // TCP header for the final ACK.
-    tcp->source = htons(client_port);
-    tcp->dest = htons(SERVER_PORT);
-    tcp->seq = htonl(CLIENT_FINAL_ACK_SEQ);
-    tcp->ack_seq = htonl(server_seq + 1);
-    tcp->doff = sizeof(struct tcphdr) / 4;
-    tcp->syn = 0;
-    tcp->ack = 1;
-    tcp->fin = 0;
-    tcp->rst = 0;
-    tcp->psh = 0;
-    tcp->window = htons(8192);
-    tcp->check = 0;
+// Constructs and sends an SYN packet, offering the options Linux offers: MSS, window scale, SACK and timestamps.
+void send_syn(int sock, const char *client_ip, int client_port, const char *server_ip)
+{
+    packet::Segment syn;
+    syn.saddr = ntohl(inet_addr(client_ip));
+    syn.daddr = ntohl(inet_addr(server_ip));
+    syn.source = client_port;
+    syn.dest = SERVER_PORT;
+    syn.seq = CLIENT_SYN_SEQ;
+    syn.flags = packet::SYN;
+    syn.window = CLIENT_WINDOW;
+    syn.ip_id = 54321;
+    syn.options.mss = CLIENT_MSS;
+    syn.options.wscale = CLIENT_WSCALE;
+    syn.options.sack_permitted = true;
+    syn.options.timestamps = true;
+    syn.options.ts_val = timestamp_ms();
 
-    struct sockaddr_in dest_addr;
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(SERVER_PORT);
-    dest_addr.sin_addr.s_addr = inet_addr(server_ip);
+    // Headers, options and both checksums (the kernel would only fill in the IP one).
+    uint8_t buffer[MAX_PACKET_SIZE];
+    size_t len = packet::build_segment(buffer, syn);
 
-    cout << "[+] Client sending final ACK..." << endl;
-    print_tcp_flags(tcp);
+    cout << "[+] Client sending SYN..." << endl;
+    // Print the TCP header flags (matches server's debug style).
+    print_tcp_flags(packet::TcpView(buffer + packet::IP_HEADER_LEN));
+    print_tcp_options(syn.options);
+    send_packet(sock, buffer, len, server_ip, "SYN");
+}
 
-    if (sendto(sock, packet, PACKET_SIZE, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0)
-    {
-        perror("sendto() failed for final ACK packet");
-    }
-    else
+// Constructs and sends the final ACK packet (client’s ACK to complete the handshake).
+// It carries a timestamp if the server agreed to use them, echoing the server's.
+void send_final_ack(int sock, const char *client_ip, int client_port, const char *server_ip, uint32_t server_seq,
+                    const packet::TcpOptions &server_options)
+{
+    packet::Segment ack;
+    ack.saddr = ntohl(inet_addr(client_ip));
+    ack.daddr = ntohl(inet_addr(server_ip));
+    ack.source = client_port;
+    ack.dest = SERVER_PORT;
+    ack.seq = CLIENT_FINAL_ACK_SEQ;
+    ack.ack_seq = server_seq + 1;
+    ack.flags = packet::ACK;
+    // The window in segments other than SYNs is scaled if both sides sent the option
+    ack.window = server_options.wscale >= 0 ? CLIENT_WINDOW >> CLIENT_WSCALE : CLIENT_WINDOW;
+    ack.ip_id = 54321;
+    if (server_options.timestamps)
     {
-        cout << "[+] Final ACK sent" << endl;
+        ack.options.timestamps = true;
+        ack.options.ts_val = timestamp_ms();
+        ack.options.ts_ecr = server_options.ts_val;
     }
+
+    uint8_t buffer[MAX_PACKET_SIZE];
+    size_t len = packet::build_segment(buffer, ack);
+
+    cout << "[+] Client sending final ACK..." << endl;
+    print_tcp_flags(packet::TcpView(buffer + packet::IP_HEADER_LEN));
+    send_packet(sock, buffer, len, server_ip, "Final ACK");
 }
 
 // Performs the complete three-way handshake by sending the SYN, waiting for the SYN-ACK, and sending the ACK.
 void perform_hand_shake(const char *client_ip, int client_port, const char *server_ip)
 {
     int sock = create_raw_socket();
+    // Only packets from the server port are queued, everything else is dropped by the kernel
+    attach_tcp_port_filter(sock, MATCH_SOURCE_PORT, SERVER_PORT);
 
     // Step 1: Send SYN to the server.
     send_syn(sock, client_ip, client_port, server_ip);
 
     // Step 2: Wait for SYN-ACK from the server.
     cout << "[+] Waiting for SYN-ACK from " << server_ip << "..." << endl;
-    char buffer[65536];
+    uint8_t buffer[65536];
     struct sockaddr_in src_addr;
     socklen_t addr_len = sizeof(src_addr);
     uint32_t server_seq = 0;
+    packet::TcpOptions server_options;
     bool synack_received = false;
 
     while (!synack_received)
@@ -181,32 +214,923 @@ void perform_hand_shake(const char *client_ip, int client_port, const char *serv
             perror("recvfrom() failed");
             continue;
         }
-        struct iphdr *ip = (struct iphdr *)buffer;
-        struct tcphdr *tcp = (struct tcphdr *)(buffer + (ip->ihl * 4));
+        if (capture)
+            capture->log(buffer, data_size);
+        packet::IpView ip(buffer);
+        if (data_size < (int)(packet::IP_HEADER_LEN + packet::TCP_HEADER_LEN) ||
+            data_size < (int)(ip.header_length() + packet::TCP_HEADER_LEN))
+            continue;
+        packet::TcpView tcp(ip.payload());
 
         // Make sure the packet is from the expected server port and destined to our client port.
-        if (ntohs(tcp->source) != SERVER_PORT || ntohs(tcp->dest) != client_port)
+        if (tcp.source() != SERVER_PORT || tcp.dest() != client_port)
             continue;
 
         // Print the TCP flags received (aligned with server output style).
         print_tcp_flags(tcp);
 
         // Check for SYN-ACK: SYN and ACK must be set, and ack_seq should be CLIENT_SYN_SEQ+1.
-        if (tcp->syn == 1 && tcp->ack == 1 && ntohl(tcp->ack_seq) == CLIENT_SYN_SEQ + 1)
+        if (tcp.has(packet::SYN | packet::ACK) && tcp.ack_seq() == CLIENT_SYN_SEQ + 1)
         {
-            server_seq = ntohl(tcp->seq);
+            server_seq = tcp.seq();
+            size_t options_len = min(tcp.options_length(), (size_t)data_size - ip.header_length() - packet::TCP_HEADER_LEN);
+            server_options = packet::parse_tcp_options(tcp.options(), options_len);
+            print_tcp_options(server_options);
             cout << "[+] Received SYN-ACK from " << inet_ntoa(src_addr.sin_addr) << endl;
             synack_received = true;
         }
     }
 
     // Step 3: Send final ACK.
-    send_final_ack(sock, client_ip, client_port, server_ip, server_seq);
+    send_final_ack(sock, client_ip, client_port, server_ip, server_seq, server_options);
     cout << "[+] Handshake complete." << endl;
     close(sock);
 }
 
-int main()
+// Options of the load generator (--load) and of the SYN flood (--syn-flood, which sends the SYNs only).
+struct LoadOptions
+{
+    long count = 0;         // handshakes to start
+    int batch = 64;         // packets per sendmmsg() call
+    int window = 4096;      // most handshakes waiting for their SYN-ACK at a time
+    int sources = 1;        // source addresses 127.0.0.1 .. 127.0.0.<sources>
+    int timeout_ms = 1000;  // a handshake without SYN-ACK after this long counts as lost
+    bool answer = true;     // send the final ACKs, false for a SYN flood
+    bool filter = true;     // let the kernel drop packets that don't come from SERVER_PORT (BPF)
+};
+
+// One source address and port of the load generator.
+struct Flow
+{
+    uint32_t isn = 0;      // sequence number of the SYN
+    uint64_t sent_ns = 0;  // when the SYN was sent
+    bool pending = false;  // waiting for the SYN-ACK
+};
+
+// A batch of packets sent with a single sendmmsg(), built from one template.
+struct PacketBatch
+{
+    vector<uint8_t> packets;
+    vector<struct iovec> iov;
+    vector<struct mmsghdr> msgs;
+    struct sockaddr_in dest_addr;
+    size_t packet_size = 0;  // every packet of the batch has the template's size
+    int size = 0;            // packets filled in so far
+
+    uint8_t *slot(int i) { return &packets[i * packet_size]; }
+};
+
+uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The template of the load generator's SYNs or ACKs: every field that doesn't change between handshakes.
+// The SYNs offer MSS, window scale and SACK but no timestamps, so the ACKs need no options.
+packet::Segment load_template(const char *server_ip, bool syn)
+{
+    packet::Segment segment;
+    segment.daddr = ntohl(inet_addr(server_ip));
+    segment.dest = SERVER_PORT;
+    segment.flags = syn ? packet::SYN : packet::ACK;
+    segment.window = syn ? CLIENT_WINDOW : CLIENT_WINDOW >> CLIENT_WSCALE;
+    if (syn)
+    {
+        segment.options.mss = CLIENT_MSS;
+        segment.options.wscale = CLIENT_WSCALE;
+        segment.options.sack_permitted = true;
+    }
+    return segment;
+}
+
+// Points one message at each slot of packet_size bytes, all of them addressed to the server.
+void init_batch_messages(PacketBatch &batch, int capacity, size_t packet_size, const char *server_ip)
+{
+    batch.packet_size = packet_size;
+    batch.packets.resize(capacity * batch.packet_size);
+    batch.iov.resize(capacity);
+    batch.msgs.resize(capacity);
+    memset(&batch.dest_addr, 0, sizeof(batch.dest_addr));
+    batch.dest_addr.sin_family = AF_INET;
+    batch.dest_addr.sin_port = htons(SERVER_PORT);
+    batch.dest_addr.sin_addr.s_addr = inet_addr(server_ip);
+    memset(batch.msgs.data(), 0, capacity * sizeof(struct mmsghdr));
+
+    for (int i = 0; i < capacity; i++)
+    {
+        batch.iov[i].iov_base = batch.slot(i);
+        batch.iov[i].iov_len = batch.packet_size;
+        batch.msgs[i].msg_hdr.msg_iov = &batch.iov[i];
+        batch.msgs[i].msg_hdr.msg_iovlen = 1;
+        batch.msgs[i].msg_hdr.msg_name = &batch.dest_addr;
+        batch.msgs[i].msg_hdr.msg_namelen = sizeof(batch.dest_addr);
+    }
+}
+
+// Builds the template straight into every slot of the batch.
+void init_batch(PacketBatch &batch, int capacity, const char *server_ip, bool syn)
+{
+    packet::Segment segment = load_template(server_ip, syn);
+    init_batch_messages(batch, capacity, packet::segment_length(segment), server_ip);
+    for (int i = 0; i < capacity; i++)
+        packet::build_segment(batch.slot(i), segment);
+}
+
+// Patches the fields that change between handshakes into the next slot of the batch. The slot's
+// checksums are valid for the values it held before, so they are updated for the changed fields
+// only (RFC 1624); the source address is also part of the TCP pseudo header.
+void add_to_batch(PacketBatch &batch, uint32_t saddr, uint16_t port, uint32_t seq, uint32_t ack_seq)
+{
+    uint8_t *ip = batch.slot(batch.size++);
+    uint8_t *tcp = ip + packet::IP_HEADER_LEN;
+    uint8_t *tcp_check = tcp + packet::TCP_CHECK;
+    uint8_t saddr_copy[4];
+
+    memcpy(saddr_copy, ip + packet::IP_SADDR, 4);  // the TCP checksum needs the same change
+    packet::patch32(ip + packet::IP_SADDR, saddr, ip + packet::IP_CHECK);
+    packet::patch32(saddr_copy, saddr, tcp_check);
+    packet::patch16(tcp + packet::TCP_SOURCE, port, tcp_check);
+    packet::patch32(tcp + packet::TCP_SEQ, seq, tcp_check);
+    packet::patch32(tcp + packet::TCP_ACK_SEQ, ack_seq, tcp_check);
+}
+
+// Sends the filled slots, returns how many were sent. Unsent packets stay at the front of the batch.
+int send_batch(int sock, PacketBatch &batch)
+{
+    int sent = 0;
+    while (sent < batch.size)
+    {
+        int n = sendmmsg(sock, &batch.msgs[sent], batch.size - sent, 0);
+        if (n <= 0)
+            break;
+        for (int i = sent; capture && i < sent + n; i++)
+            capture->log(batch.slot(i), batch.iov[i].iov_len);
+        sent += n;
+    }
+    if (sent > 0 && sent < batch.size)
+    {
+        memmove(batch.slot(0), batch.slot(sent), (batch.size - sent) * batch.packet_size);
+        for (int i = 0; i < batch.size - sent; i++)  // the packets of a data batch differ in length
+            batch.iov[i].iov_len = batch.iov[i + sent].iov_len;
+    }
+    batch.size -= sent;
+    return sent;
+}
+
+// The p-th percentile (0 to 1) of sorted values, 0 if there are none.
+uint32_t percentile(const vector<uint32_t> &sorted, double p)
+{
+    return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+// Prints RTT percentiles and a histogram with power-of-two buckets in microseconds. Sorts rtts_us.
+void print_rtt_histogram(vector<uint32_t> &rtts_us)
+{
+    if (rtts_us.empty())
+        return;
+    sort(rtts_us.begin(), rtts_us.end());
+    cout << "[+] RTT (us): p50 " << percentile(rtts_us, 0.50) << "  p90 " << percentile(rtts_us, 0.90)
+         << "  p99 " << percentile(rtts_us, 0.99) << "  max " << rtts_us.back() << endl;
+
+    vector<size_t> buckets(33, 0);
+    for (uint32_t rtt : rtts_us)
+        buckets[rtt ? 32 - __builtin_clz(rtt) : 0]++;
+    size_t largest = *max_element(buckets.begin(), buckets.end());
+    for (int b = 0; b < 33; b++)
+    {
+        if (buckets[b] == 0)
+            continue;
+        uint64_t low = b ? 1ULL << (b - 1) : 0;
+        printf("    %8llu - %-8llu us %9zu  %s\n", (unsigned long long)low, (unsigned long long)(1ULL << b) - 1,
+               buckets[b], string(buckets[b] * 50 / largest, '#').c_str());
+    }
+}
+
+// Starts handshakes from many source addresses and ports as fast as the window allows. SYNs (and final ACKs)
+// are sent in batches with sendmmsg(); SYN-ACKs are matched to their handshake as they arrive, so many
+// handshakes are in flight at once. Reports handshakes per second and the SYN to SYN-ACK round trip times.
+void run_load(const char *server_ip, const LoadOptions &options)
+{
+    int sock = create_raw_socket();
+    if (options.filter && !attach_tcp_port_filter(sock, MATCH_SOURCE_PORT, SERVER_PORT))
+        exit(EXIT_FAILURE);
+    int rcvbuf = LOAD_RCVBUF_SIZE;
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    const long slots = (long)options.sources * LOAD_PORT_COUNT;  // distinct (address, port) pairs
+    const uint32_t first_addr = ntohl(inet_addr(LOAD_FIRST_ADDR));
+    const uint32_t server_addr = ntohl(inet_addr(server_ip));
+    const long window = options.answer ? min((long)options.window, slots) : LONG_MAX;
+    vector<Flow> flows(options.answer ? slots : 0);
+    deque<pair<long, uint64_t>> in_flight;  // (slot, sent_ns) in send order, to find lost handshakes
+    vector<uint32_t> rtts_us;
+    rtts_us.reserve(options.count);
+
+    PacketBatch syns, acks;
+    init_batch(syns, options.batch, server_ip, true);
+    init_batch(acks, options.batch, server_ip, false);
+
+    mt19937 rng(random_device{}());
+    long next = 0, outstanding = 0, completed = 0, lost = 0, syns_sent = 0;
+    uint8_t buffer[65536];
+    uint64_t start = now_ns();
+
+    while (next < options.count || outstanding > 0)
+    {
+        // Send the next batch of SYNs, sweeping the source addresses fastest so consecutive SYNs differ in address.
+        // A slot whose handshake from one sweep earlier is still pending stops the batch until it resolves.
+        bool slot_busy = false;
+        while (syns.size < options.batch && next + syns.size < options.count && outstanding + syns.size < window)
+        {
+            long i = next + syns.size;
+            if (options.answer && flows[i % slots].pending)
+            {
+                slot_busy = true;
+                break;
+            }
+            uint32_t saddr = first_addr + i % options.sources;
+            uint16_t port = LOAD_FIRST_PORT + (i / options.sources) % LOAD_PORT_COUNT;
+            uint32_t isn = rng();
+            if (options.answer)
+                flows[i % slots].isn = isn;
+            add_to_batch(syns, saddr, port, isn, 0);
+        }
+        uint64_t sent_at = now_ns();
+        int sent = send_batch(sock, syns);
+        for (int k = 0; k < sent; k++, next++, syns_sent++)
+        {
+            if (!options.answer)
+                continue;
+            long slot = next % slots;
+            flows[slot].pending = true;
+            flows[slot].sent_ns = sent_at;
+            in_flight.push_back({slot, sent_at});
+            outstanding++;
+        }
+        if (!options.answer)
+            continue;
+
+        // Match the SYN-ACKs that arrived so far and queue the final ACKs.
+        bool received = false;
+        while (true)
+        {
+            int data_size = recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (data_size < (int)(packet::IP_HEADER_LEN + packet::TCP_HEADER_LEN))
+                break;
+            if (capture)
+                capture->log(buffer, data_size);
+            packet::IpView ip(buffer);
+            packet::TcpView tcp(ip.payload());
+            if (ip.saddr() != server_addr || tcp.source() != SERVER_PORT || !tcp.has(packet::SYN | packet::ACK))
+                continue;
+            long addr_index = (long)ip.daddr() - first_addr;
+            long port_index = (long)tcp.dest() - LOAD_FIRST_PORT;
+            if (addr_index < 0 || addr_index >= options.sources || port_index < 0)
+                continue;
+            Flow &flow = flows[port_index * options.sources + addr_index];
+            if (!flow.pending || tcp.ack_seq() != flow.isn + 1)
+                continue;
+
+            received = true;
+            flow.pending = false;
+            outstanding--;
+            completed++;
+            rtts_us.push_back((now_ns() - flow.sent_ns) / 1000);
+            add_to_batch(acks, ip.daddr(), tcp.dest(), flow.isn + 1, tcp.seq() + 1);
+            if (acks.size == options.batch)
+                send_batch(sock, acks);
+        }
+        send_batch(sock, acks);
+
+        // Give up on handshakes whose SYN-ACK is overdue.
+        uint64_t now = now_ns();
+        while (!in_flight.empty())
+        {
+            Flow &flow = flows[in_flight.front().first];
+            if (flow.pending && flow.sent_ns == in_flight.front().second)
+            {
+                if (now - flow.sent_ns < (uint64_t)options.timeout_ms * 1000000)
+                    break;
+                flow.pending = false;
+                outstanding--;
+                lost++;
+            }
+            in_flight.pop_front();
+        }
+
+        // Nothing to send and nothing arrived: wait for the next SYN-ACK instead of spinning.
+        if (!received && (next == options.count || outstanding >= window || slot_busy))
+        {
+            struct pollfd pfd = {sock, POLLIN, 0};
+            poll(&pfd, 1, 1);
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    if (!options.answer)
+    {
+        cout << "[+] SYN flood: sent " << syns_sent << " of " << options.count << " SYNs in " << seconds << " s ("
+             << (long)(syns_sent / seconds) << " SYNs/s)" << endl;
+        close(sock);
+        return;
+    }
+    cout << "[+] Load: " << options.count << " handshakes, " << completed << " completed, " << lost << " lost in "
+         << seconds << " s from " << options.sources << " address(es)" << endl;
+    cout << "[+] handshakes/s: " << (long)(completed / seconds) << endl;
+    print_rtt_histogram(rtts_us);
+    close(sock);
+}
+
+// Options of the bulk transfer (--transfer).
+struct TransferOptions
+{
+    long bytes = 0;      // data to send, less than 2 GB so the sequence numbers of the transfer compare correctly
+    int batch = 64;      // segments per sendmmsg() call
+    bool kernel = true;  // send the same amount over kernel TCP afterwards, for comparison
+    bool filter = true;  // let the kernel drop packets that don't come from SERVER_PORT (BPF)
+    vector<string> algorithms = {"reno"};  // one transfer per congestion control algorithm
+    NetemOptions netem;  // loss, delay and rate of the emulated link the data goes through
+};
+
+// The user-space sender. Names follow RFC 9293: everything before snd_una is acknowledged and snd_nxt
+// is the next sequence number to send. snd_max is the highest sent so far; it is ahead of snd_nxt
+// after a timeout, when everything after snd_una is sent again.
+struct TcpSender
+{
+    int sock = -1;
+    PacketBatch batch;          // segments built by the sender
+    PacketBatch wire;           // packets leaving the emulated link
+    unique_ptr<CongestionControl> cc;
+    unique_ptr<LinkEmulator> link;  // null without --loss, --delay or --rate
+    packet::Segment segment;    // addresses, ports and window, the same in every segment
+    vector<uint8_t> payload;    // the data, the same bytes in every segment
+    uint32_t iss = 0;
+    uint32_t snd_una = 0;
+    uint32_t snd_nxt = 0;
+    uint32_t snd_max = 0;
+    uint32_t fin_seq = 0;       // sequence number of the FIN, right after the data
+    uint64_t snd_wnd = 0;       // the server's receive window in bytes
+    int snd_wscale = 0;         // shift of the windows the server announces
+    uint32_t rcv_nxt = 0;       // the server's next sequence number
+    bool fin_received = false;
+    size_t mss = 0;             // payload bytes per segment, the timestamp option is taken off the MSS
+    bool timestamps = false;
+    uint32_t ts_recent = 0;     // the server's last timestamp, echoed in every segment
+    int dupacks = 0;            // duplicate ACKs in a row
+    bool in_recovery = false;   // repairing a loss found by duplicate ACKs (NewReno, RFC 6582)
+    uint32_t recover = 0;       // snd_max when the recovery started, its end
+    uint64_t delivered = 0;     // bytes acknowledged so far
+    uint64_t next_send_ns = 0;  // earliest time of the next segment when the algorithm paces
+    uint32_t max_cwnd = 0;
+
+    // Round-trip time estimation and retransmission timer (RFC 6298), in microseconds
+    int64_t srtt_us = 0;        // 0 until the first sample
+    int64_t rttvar_us = 0;
+    int64_t rto_us = RTO_INITIAL_US;
+    uint64_t rto_deadline_ns = 0;  // 0: the timer is stopped
+    bool rtt_timing = false;       // without timestamps one segment at a time is timed (Karn's algorithm)
+    uint32_t rtt_seq = 0;
+    uint64_t rtt_sent_ns = 0;
+    vector<uint32_t> rtts_us;
+
+    uint64_t segments = 0, retransmits = 0, timeouts = 0, fast_retransmits = 0, acks = 0, dup_acks = 0;
+};
+
+// The timestamp clock of the sender ticks every microsecond, loopback RTTs are far below a millisecond.
+uint32_t ts_clock(uint64_t ns)
+{
+    return (uint32_t)(ns / 1000);
+}
+
+// Feeds one RTT sample to the estimator and recomputes the timeout (RFC 6298, section 2).
+void update_rtt(TcpSender &s, int64_t rtt_us)
+{
+    rtt_us = max(rtt_us, (int64_t)1);
+    s.rtts_us.push_back((uint32_t)rtt_us);
+    if (s.srtt_us == 0)
+    {
+        s.srtt_us = rtt_us;
+        s.rttvar_us = rtt_us / 2;
+    }
+    else
+    {
+        s.rttvar_us = (3 * s.rttvar_us + llabs(s.srtt_us - rtt_us)) / 4;
+        s.srtt_us = (7 * s.srtt_us + rtt_us) / 8;
+    }
+    s.rto_us = min(max(s.srtt_us + 4 * s.rttvar_us, (int64_t)RTO_MIN_US), (int64_t)RTO_MAX_US);
+}
+
+void restart_timer(TcpSender &s, uint64_t now)
+{
+    s.rto_deadline_ns = s.snd_max == s.snd_una ? 0 : now + s.rto_us * 1000;
+}
+
+// Payload bytes of the segment starting at seq, 0 for the FIN.
+uint32_t segment_payload(const TcpSender &s, uint32_t seq)
+{
+    return min((uint32_t)s.mss, s.fin_seq - seq);
+}
+
+// Builds the segment starting at seq into the next slot of the batch: data, or the FIN once the data
+// is all sent. Returns the sequence space it takes.
+uint32_t queue_segment(TcpSender &s, uint32_t seq, uint64_t now)
+{
+    uint32_t len = segment_payload(s, seq);
+    packet::Segment &segment = s.segment;
+    segment.seq = seq;
+    segment.ack_seq = s.rcv_nxt;
+    segment.flags = len ? packet::ACK : packet::ACK | packet::FIN;
+    segment.payload_length = len;
+    segment.options.ts_val = ts_clock(now);
+    segment.options.ts_ecr = s.ts_recent;
+    s.batch.iov[s.batch.size].iov_len = packet::build_segment(s.batch.slot(s.batch.size), segment, s.payload.data());
+    s.batch.size++;
+
+    s.segments++;
+    if (packet::seq_before(seq, s.snd_max))
+        s.retransmits++;
+    else if (!s.timestamps && !s.rtt_timing)
+    {
+        s.rtt_timing = true;
+        s.rtt_seq = seq;
+        s.rtt_sent_ns = now;
+    }
+    return len ? len : 1;
+}
+
+// Queues segments from snd_nxt on while the congestion window and the server's window have room
+// for them, and the pacing rate allows. With nothing in flight one segment is always sent, so a
+// window smaller than a segment can't stall the transfer.
+void fill_window(TcpSender &s, int batch, uint64_t now)
+{
+    uint64_t window = min(s.snd_wnd, (uint64_t)s.cc->window());
+    uint64_t rate = s.cc->pacing_rate();
+    while (s.batch.size < batch && packet::seq_before(s.snd_nxt, s.fin_seq + 1))
+    {
+        uint32_t in_flight = s.snd_nxt - s.snd_una;
+        uint32_t len = segment_payload(s, s.snd_nxt);
+        if (in_flight > 0 && in_flight + len > window)
+            break;
+        if (rate && s.next_send_ns > now)
+            break;
+        if (rate)
+            s.next_send_ns = max(s.next_send_ns, now - PACING_SLACK_NS) + (packet::IP_HEADER_LEN + packet::TCP_HEADER_LEN + len) * 1000000000ULL / rate;
+        s.snd_nxt += queue_segment(s, s.snd_nxt, now);
+        if (packet::seq_after(s.snd_nxt, s.snd_max))
+            s.snd_max = s.snd_nxt;
+    }
+}
+
+// Queues the first unacknowledged segment again, if the batch has room (the timer covers it otherwise).
+void retransmit_first(TcpSender &s, uint64_t now)
+{
+    s.rtt_timing = false;
+    if (s.batch.size < (int)s.batch.msgs.size())
+        queue_segment(s, s.snd_una, now);
+}
+
+// Processes an ACK from the server: moves snd_una and the window, samples the RTT and feeds the
+// congestion control. The third duplicate ACK in a row starts a fast retransmit (RFC 5681); until
+// everything sent before it is acknowledged, each partial ACK retransmits the next hole (NewReno).
+void process_ack(TcpSender &s, const packet::IpView &ip, const packet::TcpView &tcp, size_t data_size, uint64_t now)
+{
+    size_t options_len = min(tcp.options_length(), data_size - ip.header_length() - packet::TCP_HEADER_LEN);
+    packet::TcpOptions options = packet::parse_tcp_options(tcp.options(), options_len);
+    uint32_t ack = tcp.ack_seq();
+    bool has_data = ip.total_length() > ip.header_length() + tcp.header_length();
+    s.acks++;
+    if (s.timestamps && options.timestamps)
+        s.ts_recent = options.ts_val;
+    if (tcp.has(packet::FIN) && !s.fin_received)
+    {
+        s.fin_received = true;
+        s.rcv_nxt = tcp.seq() + 1;
+    }
+    if (packet::seq_after(ack, s.snd_max))
+        return;  // acknowledges something never sent
+
+    if (packet::seq_after(ack, s.snd_una))
+    {
+        int64_t rtt_us = 0;
+        if (s.timestamps && options.timestamps && options.ts_ecr)
+            rtt_us = max((int32_t)(ts_clock(now) - options.ts_ecr), 1);
+        else if (s.rtt_timing && packet::seq_after(ack, s.rtt_seq))
+        {
+            rtt_us = max((int64_t)(now - s.rtt_sent_ns) / 1000, (int64_t)1);
+            s.rtt_timing = false;
+        }
+        if (rtt_us)
+            update_rtt(s, rtt_us);
+        uint32_t acked = ack - s.snd_una;
+        s.delivered += acked;
+        s.snd_una = ack;
+        if (packet::seq_before(s.snd_nxt, s.snd_una))
+            s.snd_nxt = s.snd_una;  // the server had the rest already
+        s.snd_wnd = (uint64_t)tcp.window() << s.snd_wscale;
+        s.dupacks = 0;
+        if (s.in_recovery && packet::seq_before(ack, s.recover))
+            retransmit_first(s, now);  // partial ACK: the next hole
+        else if (s.in_recovery)
+        {
+            s.in_recovery = false;
+            s.cc->on_recovery_end();
+        }
+        s.cc->on_ack({now / 1000, acked, s.snd_nxt - s.snd_una, rtt_us, s.delivered, s.in_recovery});
+        s.max_cwnd = max(s.max_cwnd, s.cc->window());
+        restart_timer(s, now);
+    }
+    else if (ack == s.snd_una && s.snd_max != s.snd_una && !has_data && !tcp.has(packet::FIN))
+    {
+        s.dup_acks++;
+        s.snd_wnd = (uint64_t)tcp.window() << s.snd_wscale;
+        if (++s.dupacks == DUPACK_THRESHOLD && !s.in_recovery)
+        {
+            s.fast_retransmits++;
+            s.in_recovery = true;
+            s.recover = s.snd_max;
+            s.cc->on_loss(s.snd_nxt - s.snd_una, now / 1000);
+            retransmit_first(s, now);
+        }
+    }
+}
+
+// The retransmission timer expired: double the timeout (RFC 6298, 5.5) and send everything from snd_una again.
+void process_timeout(TcpSender &s, uint64_t now)
+{
+    s.timeouts++;
+    s.cc->on_timeout(s.snd_nxt - s.snd_una, now / 1000);
+    s.in_recovery = false;
+    s.rto_us = min(s.rto_us * 2, (int64_t)RTO_MAX_US);
+    s.snd_nxt = s.snd_una;
+    s.dupacks = 0;
+    s.rtt_timing = false;
+    s.rto_deadline_ns = now + s.rto_us * 1000;
+}
+
+// Reads the packet the server sent to this connection, if one is queued. Kernel RSTs are skipped.
+bool receive_from_server(TcpSender &s, uint8_t *buffer, size_t size, int &data_size)
+{
+    while (true)
+    {
+        data_size = recv(s.sock, buffer, size, MSG_DONTWAIT);
+        if (data_size < (int)(packet::IP_HEADER_LEN + packet::TCP_HEADER_LEN))
+            return false;
+        if (capture)
+            capture->log(buffer, data_size);
+        packet::IpView ip(buffer);
+        if (data_size < (int)(ip.header_length() + packet::TCP_HEADER_LEN))
+            continue;
+        packet::TcpView tcp(ip.payload());
+        if (ip.saddr() == s.segment.daddr && tcp.source() == s.segment.dest && tcp.dest() == s.segment.source &&
+            tcp.has(packet::ACK) && !tcp.has(packet::RST))
+            return true;
+    }
+}
+
+// Sends a bare ACK of everything the server sent.
+void send_transfer_ack(TcpSender &s, uint32_t seq, const char *server_ip, const char *what)
+{
+    packet::Segment ack = s.segment;
+    ack.seq = seq;
+    ack.ack_seq = s.rcv_nxt;
+    ack.flags = packet::ACK;
+    ack.payload_length = 0;
+    ack.options.ts_val = ts_clock(now_ns());
+    ack.options.ts_ecr = s.ts_recent;
+    uint8_t buffer[MAX_PACKET_SIZE];
+    size_t len = packet::build_segment(buffer, ack);
+    send_packet(s.sock, buffer, len, server_ip, what);
+}
+
+// The handshake of the transfer: a SYN with every option, sent again with a doubled timeout when no
+// SYN-ACK comes back, then the final ACK. Unlike the assignment's handshake the sequence numbers are
+// real: a random ISN, and the ACK and the data start at ISN + 1.
+bool open_connection(TcpSender &s, const char *client_ip, const char *server_ip, uint8_t *buffer, size_t size)
+{
+    mt19937 rng(random_device{}());
+    s.iss = rng();
+    s.segment.saddr = ntohl(inet_addr(client_ip));
+    s.segment.daddr = ntohl(inet_addr(server_ip));
+    s.segment.source = TRANSFER_FIRST_PORT + rng() % (65536 - TRANSFER_FIRST_PORT);
+    s.segment.dest = SERVER_PORT;
+
+    packet::Segment syn = s.segment;
+    syn.seq = s.iss;
+    syn.flags = packet::SYN;
+    syn.window = CLIENT_WINDOW;
+    syn.options.mss = CLIENT_MSS;
+    syn.options.wscale = CLIENT_WSCALE;
+    syn.options.sack_permitted = true;
+    syn.options.timestamps = true;
+
+    for (int attempt = 0; attempt < SYN_RETRIES; attempt++, s.rto_us *= 2)
+    {
+        uint64_t sent_ns = now_ns();
+        syn.options.ts_val = ts_clock(sent_ns);
+        uint8_t packet[MAX_PACKET_SIZE];
+        size_t len = packet::build_segment(packet, syn);
+        send_packet(s.sock, packet, len, server_ip, "SYN");
+
+        uint64_t deadline = sent_ns + s.rto_us * 1000;
+        for (uint64_t now = sent_ns; now < deadline; now = now_ns())
+        {
+            struct pollfd pfd = {s.sock, POLLIN, 0};
+            poll(&pfd, 1, (deadline - now) / 1000000 + 1);
+            int data_size;
+            while (receive_from_server(s, buffer, size, data_size))
+            {
+                packet::IpView ip(buffer);
+                packet::TcpView tcp(ip.payload());
+                if (!tcp.has(packet::SYN) || tcp.ack_seq() != s.iss + 1)
+                    continue;
+                size_t options_len = min(tcp.options_length(), data_size - ip.header_length() - packet::TCP_HEADER_LEN);
+                packet::TcpOptions options = packet::parse_tcp_options(tcp.options(), options_len);
+                print_tcp_flags(tcp);
+                print_tcp_options(options);
+                if (attempt == 0)
+                    update_rtt(s, (now_ns() - sent_ns) / 1000);
+
+                // Window scaling and timestamps are only used if both sides offered them (RFC 7323)
+                s.timestamps = options.timestamps;
+                s.ts_recent = options.ts_val;
+                s.snd_wscale = options.wscale >= 0 ? options.wscale : 0;
+                s.segment.window = options.wscale >= 0 ? CLIENT_WINDOW >> CLIENT_WSCALE : CLIENT_WINDOW;
+                s.segment.options.timestamps = s.timestamps;
+                s.mss = min(options.mss ? options.mss : DEFAULT_MSS, CLIENT_MSS) - (s.timestamps ? 12 : 0);
+                s.snd_wnd = tcp.window();  // the window of a SYN is never scaled
+                s.rcv_nxt = tcp.seq() + 1;
+                s.snd_una = s.snd_nxt = s.snd_max = s.iss + 1;
+                send_transfer_ack(s, s.iss + 1, server_ip, "ACK");
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// The same transfer over kernel TCP on loopback, to compare with: a thread accepts the connection and
+// reads until the sender shuts it down. Returns the seconds from the first write() until the receiver
+// has read everything, or -1 on error.
+double run_kernel_transfer(const char *server_ip, long bytes)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(KERNEL_PORT);
+    addr.sin_addr.s_addr = inet_addr(server_ip);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0)
+    {
+        perror("Kernel TCP receiver failed");
+        close(listener);
+        return -1;
+    }
+
+    long received = 0;
+    thread receiver([&]()
+                    {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0)
+            return;
+        vector<char> buffer(KERNEL_CHUNK);
+        ssize_t n;
+        while ((n = read(conn, buffer.data(), buffer.size())) > 0)
+            received += n;
+        close(conn); });
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect() to the kernel TCP receiver failed");
+        shutdown(listener, SHUT_RDWR);  // wakes up accept()
+        receiver.join();
+        close(sock);
+        close(listener);
+        return -1;
+    }
+    vector<char> data(KERNEL_CHUNK, 'x');
+    uint64_t start = now_ns();
+    long sent = 0;
+    while (sent < bytes)
+    {
+        ssize_t n = write(sock, data.data(), min((long)data.size(), bytes - sent));
+        if (n <= 0)
+        {
+            perror("write() failed");
+            break;
+        }
+        sent += n;
+    }
+    shutdown(sock, SHUT_WR);
+    receiver.join();
+    double seconds = (now_ns() - start) / 1e9;
+    close(sock);
+    close(listener);
+    return received == bytes ? seconds : -1;
+}
+
+// Sends the queued segments, through the emulated link if there is one. Returns how many segments left
+// the sender (dropped by the emulator included).
+int transmit(TcpSender &s, uint64_t now)
+{
+    if (!s.link)
+        return send_batch(s.sock, s.batch);
+    int queued = s.batch.size;
+    for (int i = 0; i < queued; i++)
+        s.link->enqueue(s.batch.slot(i), s.batch.iov[i].iov_len, now);
+    s.batch.size = 0;
+    s.link->release(now, (int)s.wire.msgs.size() - s.wire.size, [&](const uint8_t *data, size_t len)
+                    {
+        memcpy(s.wire.slot(s.wire.size), data, len);
+        s.wire.iov[s.wire.size++].iov_len = len; });
+    send_batch(s.sock, s.wire);
+    return queued;
+}
+
+// Nothing to send and nothing received: waits for an ACK, at most until the retransmission timer,
+// the pacing timer or the emulated link is due, or 1 ms if the socket buffer was full.
+void wait_for_event(TcpSender &s, uint64_t now)
+{
+    uint64_t until = s.rto_deadline_ns ? s.rto_deadline_ns : now + 1000000;
+    if (s.batch.size || s.wire.size)
+        until = min(until, now + 1000000);
+    if (s.cc->pacing_rate() && s.next_send_ns > now && packet::seq_before(s.snd_nxt, s.fin_seq + 1))
+        until = min(until, s.next_send_ns);
+    if (s.link && s.link->next_due())
+        until = min(until, max(s.link->next_due(), now));
+    struct pollfd pfd = {s.sock, POLLIN, 0};
+    struct timespec timeout = {(time_t)((until - now) / 1000000000), (long)((until - now) % 1000000000)};
+    ppoll(&pfd, 1, &timeout, nullptr);
+}
+
+// Summary of one transfer, for the comparison of the algorithms.
+struct TransferResult
+{
+    string algorithm;
+    double seconds = 0;
+    uint64_t retransmits = 0;
+    uint32_t rtt_p50_us = 0;
+    uint32_t rtt_p99_us = 0;
+    uint32_t max_cwnd = 0;
+    NetemStats link;
+};
+
+// Sends options.bytes to the server over a user-space TCP connection: a sliding window bounded by the
+// congestion window and the server's (scaled) receive window, cumulative ACKs, a retransmission timer
+// driven by RTT estimates, and fast retransmit with NewReno recovery. Segments are sent in batches
+// with sendmmsg(), through the emulated link if one is configured.
+TransferResult run_user_transfer(const char *client_ip, const char *server_ip, const TransferOptions &options,
+                                 const string &algorithm)
+{
+    TcpSender s;
+    s.sock = create_raw_socket();
+    if (options.filter && !attach_tcp_port_filter(s.sock, MATCH_SOURCE_PORT, SERVER_PORT))
+        exit(EXIT_FAILURE);
+    int rcvbuf = LOAD_RCVBUF_SIZE;
+    if (setsockopt(s.sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+        setsockopt(s.sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    uint8_t buffer[65536];
+    if (!open_connection(s, client_ip, server_ip, buffer, sizeof(buffer)))
+    {
+        cerr << "[-] No SYN-ACK from the server" << endl;
+        exit(EXIT_FAILURE);
+    }
+    s.cc = make_congestion_control(algorithm, s.mss);
+    if (options.netem.enabled())
+    {
+        s.link.reset(new LinkEmulator(options.netem));
+        init_batch_messages(s.wire, options.batch, MAX_PACKET_SIZE + CLIENT_MSS, server_ip);
+    }
+    s.fin_seq = s.iss + 1 + (uint32_t)options.bytes;
+    s.payload.resize(s.mss);
+    for (size_t i = 0; i < s.payload.size(); i++)
+        s.payload[i] = 'a' + i % 26;
+    init_batch_messages(s.batch, options.batch, MAX_PACKET_SIZE + CLIENT_MSS, server_ip);
+
+    uint64_t start = now_ns();
+    while (packet::seq_before(s.snd_una, s.fin_seq + 1))
+    {
+        uint64_t now = now_ns();
+        fill_window(s, options.batch, now);
+        bool sent = transmit(s, now) > 0;
+        if (s.rto_deadline_ns == 0)
+            restart_timer(s, now);
+
+        bool received = false;
+        int data_size;
+        while (receive_from_server(s, buffer, sizeof(buffer), data_size))
+        {
+            packet::IpView ip(buffer);
+            process_ack(s, ip, packet::TcpView(ip.payload()), data_size, now_ns());
+            received = true;
+        }
+
+        now = now_ns();
+        if (s.rto_deadline_ns && now >= s.rto_deadline_ns)
+            process_timeout(s, now);
+        else if (!sent && !received)
+            wait_for_event(s, now);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    // The server answers the FIN with its own, usually in the same segment as the ACK of ours
+    for (uint64_t deadline = now_ns() + s.rto_us * 1000; !s.fin_received && now_ns() < deadline;)
+    {
+        struct pollfd pfd = {s.sock, POLLIN, 0};
+        poll(&pfd, 1, 1);
+        int data_size;
+        while (receive_from_server(s, buffer, sizeof(buffer), data_size))
+        {
+            packet::IpView ip(buffer);
+            process_ack(s, ip, packet::TcpView(ip.payload()), data_size, now_ns());
+        }
+    }
+    if (s.fin_received)
+        send_transfer_ack(s, s.fin_seq + 1, server_ip, "ACK of the server's FIN");
+    close(s.sock);
+
+    cout << "[+] User-space TCP (" << s.cc->name() << "): " << options.bytes << " bytes in " << seconds << " s, goodput "
+         << options.bytes * 8 / seconds / 1e6 << " Mbit/s" << endl;
+    cout << "    MSS " << s.mss << ", window scale " << s.snd_wscale << ", timestamps " << (s.timestamps ? "on" : "off")
+         << ", segments " << s.segments << ", retransmitted " << s.retransmits << " (" << s.timeouts << " timeouts, "
+         << s.fast_retransmits << " fast retransmits), ACKs " << s.acks << " (" << s.dup_acks << " duplicate)" << endl;
+    cout << "    SRTT " << s.srtt_us << " us, RTTVAR " << s.rttvar_us << " us, RTO " << s.rto_us / 1000
+         << " ms, congestion window " << s.cc->window() << " bytes (largest " << s.max_cwnd << ")" << endl;
+    TransferResult result;
+    if (s.link)
+    {
+        result.link = s.link->statistics();
+        cout << "    Emulated link: " << result.link.packets << " packets, " << result.link.lost << " lost, "
+             << result.link.overflowed << " dropped by the full queue, longest queue " << result.link.max_queue << endl;
+    }
+    print_rtt_histogram(s.rtts_us);
+
+    result.algorithm = s.cc->name();
+    result.seconds = seconds;
+    result.retransmits = s.retransmits;
+    result.rtt_p50_us = percentile(s.rtts_us, 0.50);
+    result.rtt_p99_us = percentile(s.rtts_us, 0.99);
+    result.max_cwnd = s.max_cwnd;
+    return result;
+}
+
+// Runs one transfer per congestion control algorithm and compares them, then compares with kernel TCP
+// (not when the link is emulated, kernel TCP doesn't go through the emulator).
+void run_transfer(const char *client_ip, const char *server_ip, const TransferOptions &options)
+{
+    vector<TransferResult> results;
+    for (const string &algorithm : options.algorithms)
+        results.push_back(run_user_transfer(client_ip, server_ip, options, algorithm));
+
+    if (results.size() > 1)
+    {
+        cout << "[+] Comparison (" << options.bytes << " bytes):" << endl;
+        printf("    %-8s %14s %12s %12s %12s %14s\n", "cc", "goodput Mbit/s", "retransmits", "RTT p50 ms", "RTT p99 ms", "max cwnd KB");
+        for (const TransferResult &r : results)
+            printf("    %-8s %14.1f %12llu %12.2f %12.2f %14u\n", r.algorithm.c_str(), options.bytes * 8 / r.seconds / 1e6,
+                   (unsigned long long)r.retransmits, r.rtt_p50_us / 1000.0, r.rtt_p99_us / 1000.0, r.max_cwnd / 1024);
+    }
+
+    if (!options.kernel || options.netem.enabled())
+        return;
+    double kernel_seconds = run_kernel_transfer(server_ip, options.bytes);
+    if (kernel_seconds < 0)
+        return;
+    cout << "[+] Kernel TCP: " << options.bytes << " bytes in " << kernel_seconds << " s, goodput "
+         << options.bytes * 8 / kernel_seconds / 1e6 << " Mbit/s" << endl;
+    cout << "[+] User-space goodput is " << 100 * kernel_seconds / results.front().seconds << "% of kernel TCP's" << endl;
+}
+
+// Writes out what is left in the capture's ring and closes it.
+void close_capture(const string &path)
+{
+    if (!capture)
+        return;
+    uint64_t logged = capture->logged(), lost = capture->lost();
+    capture.reset();
+    cout << "[+] Captured " << logged << " packets to " << path;
+    if (lost > 0)
+        cout << " (" << lost << " lost because the ring was full)";
+    cout << endl;
+}
+
+void usage(const char *program)
+{
+    cerr << "Usage: " << program << " [--pcap <file>] [mode options]\n"
+         << "       " << program << " --load <count> [--batch <n>] [--window <n>] [--sources <n>] [--timeout <ms>] [--no-filter]\n"
+         << "       " << program << " --syn-flood <count> [--batch <n>] [--sources <n>]\n"
+         << "       " << program << " --transfer <bytes> [--cc reno|cubic|bbr[,...]] [--batch <n>] [--no-kernel] [--no-filter]\n"
+         << "              [--loss <percent>] [--delay <ms>] [--rate <Mbit/s>] [--limit <packets>] [--seed <n>]\n"
+         << "--pcap <file> logs every packet sent or received to a pcap file" << endl;
+}
+
+int main(int argc, char *argv[])
 {
     // Client and server are assumed to be running on localhost.
     const char *client_ip = "127.0.0.1";
@@ -215,9 +1139,116 @@ int main()
     // Use an arbitrary client source port (>1024).
     int client_port = 54321;
 
+    // --pcap applies to every mode: take it out before the mode's options are parsed
+    string pcap_path;
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--pcap" && i + 1 < argc)
+            pcap_path = argv[++i];
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+    if (!pcap_path.empty() && !(capture = open_packet_log(pcap_path)))
+        return 1;
+
+    if (argc > 1 && string(argv[1]) == "--transfer")
+    {
+        TransferOptions options;
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--transfer" && i + 1 < argc)
+                options.bytes = atol(argv[++i]);
+            else if (arg == "--batch" && i + 1 < argc)
+                options.batch = atoi(argv[++i]);
+            else if (arg == "--cc" && i + 1 < argc)
+            {
+                options.algorithms.clear();
+                string list = argv[++i];
+                for (size_t start = 0, end; start <= list.size(); start = end + 1)
+                {
+                    end = min(list.find(',', start), list.size());
+                    options.algorithms.push_back(list.substr(start, end - start));
+                    if (!make_congestion_control(options.algorithms.back(), CLIENT_MSS))
+                    {
+                        cerr << "Unknown congestion control " << options.algorithms.back() << " (reno, cubic or bbr)" << endl;
+                        return 1;
+                    }
+                }
+            }
+            else if (arg == "--loss" && i + 1 < argc)
+                options.netem.loss = atof(argv[++i]) / 100;
+            else if (arg == "--delay" && i + 1 < argc)
+                options.netem.delay_us = (uint64_t)(atof(argv[++i]) * 1000);
+            else if (arg == "--rate" && i + 1 < argc)
+                options.netem.rate_bps = (uint64_t)(atof(argv[++i]) * 1e6);
+            else if (arg == "--limit" && i + 1 < argc)
+                options.netem.limit = atol(argv[++i]);
+            else if (arg == "--seed" && i + 1 < argc)
+                options.netem.seed = atol(argv[++i]);
+            else if (arg == "--no-kernel")
+                options.kernel = false;
+            else if (arg == "--no-filter")
+                options.filter = false;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (options.bytes <= 0 || options.bytes >= (1L << 31) || options.batch <= 0 || options.netem.limit == 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        run_transfer(client_ip, server_ip, options);
+        close_capture(pcap_path);
+        return 0;
+    }
+
+    if (argc > 1)
+    {
+        LoadOptions options;
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if ((arg == "--load" || arg == "--syn-flood") && i + 1 < argc)
+            {
+                options.count = atol(argv[++i]);
+                options.answer = arg == "--load";
+            }
+            else if (arg == "--batch" && i + 1 < argc)
+                options.batch = atoi(argv[++i]);
+            else if (arg == "--window" && i + 1 < argc)
+                options.window = atoi(argv[++i]);
+            else if (arg == "--sources" && i + 1 < argc)
+                options.sources = atoi(argv[++i]);
+            else if (arg == "--timeout" && i + 1 < argc)
+                options.timeout_ms = atoi(argv[++i]);
+            else if (arg == "--no-filter")
+                options.filter = false;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (options.count <= 0 || options.batch <= 0 || options.window <= 0 || options.sources <= 0 || options.sources > 254)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        run_load(server_ip, options);
+        close_capture(pcap_path);
+        return 0;
+    }
+
     // Initiate the handshake.
     std::cout << "[+] Starting TCP handshake..." << std::endl;
     perform_hand_shake(client_ip, client_port, server_ip);
+    close_capture(pcap_path);
 
     return 0;
 }
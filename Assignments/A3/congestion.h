@@ -0,0 +1,289 @@
+// Congestion control for the user-space TCP sender of client.cpp (--transfer --cc <name>).
+//
+// The sender tells the algorithm about every ACK of new data, about losses found by duplicate ACKs
+// (once per window, the sender does NewReno recovery itself) and about timeouts. The algorithm keeps
+// the congestion window, in bytes, and optionally a pacing rate. The sender never has more than
+// min(cwnd, receive window) bytes in flight, and spaces segments out at the pacing rate if there is one.
+//
+// Reno:  RFC 5681 with byte counting: slow start, then one MSS per window of ACKed data; halve on loss.
+// CUBIC: RFC 9438: after a loss the window follows a cubic curve back to where the loss happened and
+//        beyond, at least as fast as Reno would; multiplicative decrease by 0.7.
+// BBR:   a simplified BBR (v1): the window and pacing rate come from a model of the path, the
+//        bottleneck bandwidth (the highest delivery rate of the last 10 rounds) and the minimum RTT,
+//        instead of from losses, which are ignored.
+
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#define CC_INITIAL_WINDOW 10  // segments (RFC 6928)
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+#define BBR_HIGH_GAIN 2.885  // 2 / ln 2: doubles the sending rate every round in startup
+#define BBR_BW_ROUNDS 10  // rounds the bottleneck bandwidth estimate is the maximum of
+#define BBR_MIN_RTT_WINDOW_US 10000000  // the minimum RTT expires after 10 s, then it is probed
+#define BBR_PROBE_RTT_US 200000  // time spent at a 4-segment window to measure the minimum RTT
+
+// What the sender knows when an ACK acknowledges new data.
+struct AckSample {
+    uint64_t now_us;
+    uint32_t acked;       // bytes newly acknowledged
+    uint32_t in_flight;   // bytes still in flight
+    int64_t rtt_us;       // RTT sample of this ACK, 0 if it gave none
+    uint64_t delivered;   // bytes acknowledged since the start of the connection
+    bool in_recovery;     // the sender is repairing a loss
+};
+
+class CongestionControl {
+public:
+    explicit CongestionControl(uint32_t mss) : mss(mss), cwnd(CC_INITIAL_WINDOW * mss) {}
+    virtual ~CongestionControl() {}
+
+    virtual const char *name() const = 0;
+    virtual void on_ack(const AckSample &ack) = 0;
+    virtual void on_loss(uint32_t in_flight, uint64_t now_us) = 0;  // fast retransmit
+    virtual void on_timeout(uint32_t in_flight, uint64_t now_us) = 0;
+    virtual void on_recovery_end() {}
+    virtual uint64_t pacing_rate() const { return 0; }  // bytes per second, 0: no pacing
+
+    uint32_t window() const { return cwnd; }
+
+protected:
+    uint32_t mss;
+    uint32_t cwnd;
+    uint32_t ssthresh = UINT32_MAX;
+};
+
+class Reno : public CongestionControl {
+public:
+    using CongestionControl::CongestionControl;
+    const char *name() const override { return "reno"; }
+
+    void on_ack(const AckSample &ack) override {
+        if (ack.in_recovery)
+            return;
+        if (cwnd < ssthresh) {
+            cwnd += std::min(ack.acked, ssthresh - cwnd);  // slow start, stretch ACKs included
+            return;
+        }
+        bytes_acked += ack.acked;
+        if (bytes_acked >= cwnd) {  // congestion avoidance: one MSS per window
+            bytes_acked -= cwnd;
+            cwnd += mss;
+        }
+    }
+
+    void on_loss(uint32_t in_flight, uint64_t) override {
+        ssthresh = std::max(in_flight / 2, 2 * mss);
+        cwnd = ssthresh;
+        bytes_acked = 0;
+    }
+
+    void on_timeout(uint32_t in_flight, uint64_t) override {
+        ssthresh = std::max(in_flight / 2, 2 * mss);
+        cwnd = mss;
+        bytes_acked = 0;
+    }
+
+private:
+    uint32_t bytes_acked = 0;
+};
+
+class Cubic : public CongestionControl {
+public:
+    using CongestionControl::CongestionControl;
+    const char *name() const override { return "cubic"; }
+
+    void on_ack(const AckSample &ack) override {
+        if (ack.rtt_us > 0)
+            min_rtt_us = min_rtt_us ? std::min(min_rtt_us, ack.rtt_us) : ack.rtt_us;
+        if (ack.in_recovery)
+            return;
+        if (cwnd < ssthresh) {
+            cwnd += std::min(ack.acked, ssthresh - cwnd);
+            return;
+        }
+        double segments = (double)cwnd / mss;
+        if (epoch_start_us == 0) {  // first ACK of congestion avoidance since the last loss
+            epoch_start_us = ack.now_us;
+            w_est = segments;
+            if (segments < w_max) {
+                k = std::cbrt((w_max - segments) / CUBIC_C);
+                origin = w_max;
+            } else {
+                k = 0;
+                origin = segments;
+            }
+        }
+        // Where the curve will be one RTT from now (RFC 9438, section 4.2)
+        double t = (ack.now_us - epoch_start_us + min_rtt_us) / 1e6;
+        double target = origin + CUBIC_C * (t - k) * (t - k) * (t - k);
+        target = std::min(std::max(target, segments), 1.5 * segments);
+
+        // Reno-friendly region: never grow slower than Reno with the same decrease factor would
+        w_est += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * ack.acked / cwnd;
+        target = std::max(target, w_est);
+
+        growth += (target - segments) * ack.acked / cwnd * mss;
+        if (growth >= 1) {
+            cwnd += (uint32_t)growth;
+            growth -= (uint32_t)growth;
+        }
+    }
+
+    void on_loss(uint32_t, uint64_t) override { reduce(); }
+
+    void on_timeout(uint32_t, uint64_t) override {
+        reduce();
+        cwnd = mss;
+    }
+
+private:
+    void reduce() {
+        double segments = (double)cwnd / mss;
+        // Fast convergence: a flow that lost below its last maximum leaves room to newer flows
+        w_max = segments < w_max ? segments * (1 + CUBIC_BETA) / 2 : segments;
+        ssthresh = std::max((uint32_t)(cwnd * CUBIC_BETA), 2 * mss);
+        cwnd = ssthresh;
+        epoch_start_us = 0;
+        growth = 0;
+    }
+
+    double w_max = 0;   // window before the last reduction, in segments
+    double k = 0;       // seconds the curve takes to get back to w_max
+    double origin = 0;  // plateau of the curve, in segments
+    double w_est = 0;   // Reno's window over the same time, in segments
+    double growth = 0;  // fractional bytes of window growth not applied yet
+    uint64_t epoch_start_us = 0;
+    int64_t min_rtt_us = 0;
+};
+
+class Bbr : public CongestionControl {
+public:
+    using CongestionControl::CongestionControl;
+    const char *name() const override { return "bbr"; }
+
+    void on_ack(const AckSample &ack) override {
+        if (ack.rtt_us > 0 && (min_rtt_us == 0 || ack.rtt_us <= min_rtt_us)) {
+            min_rtt_us = ack.rtt_us;
+            min_rtt_stamp_us = ack.now_us;
+        }
+        if (min_rtt_us == 0)
+            return;
+        sample_rate(ack);
+        update_state(ack);
+
+        uint64_t bdp = bandwidth * min_rtt_us / 1000000;
+        if (state == PROBE_RTT)
+            cwnd = 4 * mss;
+        else if (bandwidth)
+            cwnd = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(cwnd_gain() * bdp, 4 * mss), UINT32_MAX / 2);
+    }
+
+    // Losses don't change the model, the window stays at 2 BDP
+    void on_loss(uint32_t, uint64_t) override {}
+    void on_timeout(uint32_t, uint64_t) override {}
+
+    uint64_t pacing_rate() const override {
+        if (bandwidth == 0)  // no estimate yet: pace the initial window over the RTT, faster in startup
+            return min_rtt_us ? (uint64_t)(BBR_HIGH_GAIN * cwnd * 1000000 / min_rtt_us) : 0;
+        return (uint64_t)(pacing_gain() * bandwidth);
+    }
+
+private:
+    enum State { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+
+    // A delivery rate sample per round trip: bytes delivered over (at least) the minimum RTT.
+    void sample_rate(const AckSample &ack) {
+        if (interval_start_us == 0) {
+            interval_start_us = ack.now_us;
+            interval_delivered = ack.delivered;
+            return;
+        }
+        uint64_t elapsed = ack.now_us - interval_start_us;
+        if (elapsed < (uint64_t)min_rtt_us)
+            return;
+        uint64_t rate = (ack.delivered - interval_delivered) * 1000000 / elapsed;
+        round++;
+        max_rates[round % BBR_BW_ROUNDS] = rate;
+        bandwidth = *std::max_element(max_rates, max_rates + BBR_BW_ROUNDS);
+        interval_start_us = ack.now_us;
+        interval_delivered = ack.delivered;
+        new_round = true;
+    }
+
+    void update_state(const AckSample &ack) {
+        bool round_start = new_round;
+        new_round = false;
+        uint64_t bdp = bandwidth * min_rtt_us / 1000000;
+
+        if (state == STARTUP && round_start) {
+            // Startup ends when three rounds in a row don't grow the bandwidth by 25%
+            if (bandwidth >= full_bandwidth * 5 / 4) {
+                full_bandwidth = bandwidth;
+                full_rounds = 0;
+            } else if (++full_rounds >= 3) {
+                state = DRAIN;
+            }
+        }
+        if (state == DRAIN && ack.in_flight <= bdp) {
+            state = PROBE_BW;
+            cycle_index = 0;
+        }
+        if (state == PROBE_BW && round_start)
+            cycle_index = (cycle_index + 1) % 8;
+
+        if (state != PROBE_RTT && ack.now_us - min_rtt_stamp_us > BBR_MIN_RTT_WINDOW_US) {
+            state = PROBE_RTT;
+            probe_rtt_done_us = ack.now_us + BBR_PROBE_RTT_US;
+            min_rtt_us = ack.rtt_us > 0 ? ack.rtt_us : min_rtt_us;
+            min_rtt_stamp_us = ack.now_us;
+        } else if (state == PROBE_RTT && ack.now_us >= probe_rtt_done_us) {
+            state = full_rounds >= 3 ? PROBE_BW : STARTUP;
+        }
+    }
+
+    double pacing_gain() const {
+        static const double cycle[8] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+        switch (state) {
+        case STARTUP: return BBR_HIGH_GAIN;
+        case DRAIN: return 1 / BBR_HIGH_GAIN;
+        case PROBE_BW: return cycle[cycle_index];
+        default: return 1;
+        }
+    }
+
+    double cwnd_gain() const { return state == STARTUP || state == DRAIN ? BBR_HIGH_GAIN : 2; }
+
+    State state = STARTUP;
+    uint64_t bandwidth = 0;          // bottleneck bandwidth estimate, bytes per second
+    uint64_t max_rates[BBR_BW_ROUNDS] = {};
+    uint64_t round = 0;
+    bool new_round = false;
+    uint64_t interval_start_us = 0;  // the delivery rate sample being measured
+    uint64_t interval_delivered = 0;
+    int64_t min_rtt_us = 0;
+    uint64_t min_rtt_stamp_us = 0;
+    uint64_t full_bandwidth = 0;
+    int full_rounds = 0;
+    int cycle_index = 0;
+    uint64_t probe_rtt_done_us = 0;
+};
+
+// Returns the algorithm called name ("reno", "cubic" or "bbr"), nullptr for an unknown name.
+inline std::unique_ptr<CongestionControl> make_congestion_control(const std::string &name, uint32_t mss) {
+    if (name == "reno")
+        return std::unique_ptr<CongestionControl>(new Reno(mss));
+    if (name == "cubic")
+        return std::unique_ptr<CongestionControl>(new Cubic(mss));
+    if (name == "bbr")
+        return std::unique_ptr<CongestionControl>(new Bbr(mss));
+    return nullptr;
+}
+
+#endif
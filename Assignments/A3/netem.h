@@ -0,0 +1,105 @@
+// A netem-style link emulator for the user-space TCP sender of client.cpp, so congestion control can
+// be compared on loopback, which never loses, delays or limits anything by itself.
+//
+// Packets the sender would send go through the emulator instead: each one is dropped with the loss
+// probability, then queued behind the packets still being serialized at the link rate (a drop-tail
+// queue of at most `limit` packets, like netem's), then held for the delay before it is really sent.
+// The loss decisions come from a seeded generator, so a run can be repeated with the same losses.
+
+#ifndef NETEM_H
+#define NETEM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+struct NetemOptions {
+    double loss = 0;         // probability a packet is dropped
+    uint64_t delay_us = 0;   // added to every packet after it leaves the queue
+    uint64_t rate_bps = 0;   // link rate in bits per second, 0: unlimited
+    size_t limit = 1000;     // packets queued for the link at most, netem's default
+    uint32_t seed = 1;
+
+    bool enabled() const { return loss > 0 || delay_us > 0 || rate_bps > 0; }
+};
+
+struct NetemStats {
+    uint64_t packets = 0;       // packets offered
+    uint64_t lost = 0;          // dropped by the loss probability
+    uint64_t overflowed = 0;    // dropped because the queue was full
+    size_t max_queue = 0;       // longest queue seen, in packets
+};
+
+class LinkEmulator {
+public:
+    explicit LinkEmulator(const NetemOptions &options) : options(options), rng(options.seed) {}
+
+    // Takes a packet the sender wants to send at time now. Returns false if it is dropped.
+    bool enqueue(const uint8_t *data, size_t len, uint64_t now_ns) {
+        stats.packets++;
+        if (options.loss > 0 && uniform(rng) < options.loss) {
+            stats.lost++;
+            return false;
+        }
+        while (!serializing.empty() && serializing.front() <= now_ns)
+            serializing.pop_front();
+        if (serializing.size() >= options.limit) {
+            stats.overflowed++;
+            return false;
+        }
+        // The packet leaves the link once the ones before it did and its own bits are out
+        uint64_t start = std::max(now_ns, link_free_ns);
+        link_free_ns = start + (options.rate_bps ? len * 8 * 1000000000ULL / options.rate_bps : 0);
+        serializing.push_back(link_free_ns);
+        stats.max_queue = std::max(stats.max_queue, serializing.size());
+
+        DelayedPacket packet;
+        if (!free_buffers.empty()) {
+            packet.data.swap(free_buffers.back());
+            free_buffers.pop_back();
+        }
+        packet.data.assign(data, data + len);
+        packet.due_ns = link_free_ns + options.delay_us * 1000;
+        in_transit.push_back(std::move(packet));
+        return true;
+    }
+
+    // When the next packet is due, 0 if none is in transit.
+    uint64_t next_due() const { return in_transit.empty() ? 0 : in_transit.front().due_ns; }
+
+    // Hands every packet due by now, in order, to send(data, len), at most max_packets of them.
+    template <typename Send>
+    int release(uint64_t now_ns, int max_packets, Send send) {
+        int count = 0;
+        while (count < max_packets && !in_transit.empty() && in_transit.front().due_ns <= now_ns) {
+            DelayedPacket &packet = in_transit.front();
+            send(packet.data.data(), packet.data.size());
+            free_buffers.push_back(std::move(packet.data));
+            in_transit.pop_front();
+            count++;
+        }
+        return count;
+    }
+
+    const NetemStats &statistics() const { return stats; }
+
+private:
+    struct DelayedPacket {
+        std::vector<uint8_t> data;
+        uint64_t due_ns = 0;
+    };
+
+    NetemOptions options;
+    NetemStats stats;
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    std::deque<uint64_t> serializing;        // when each queued packet is out on the link
+    uint64_t link_free_ns = 0;
+    std::deque<DelayedPacket> in_transit;    // in the queue or in the delay line, in send order
+    std::vector<std::vector<uint8_t>> free_buffers;  // reused for the next packets
+};
+
+#endif
@@ -0,0 +1,324 @@
+// Building and parsing the IPv4/TCP packets sent and received on the raw sockets.
+//
+// IpView and TcpView are typed views over a byte buffer: every field is read and written in place,
+// in host byte order, with shifts the compiler turns into single loads/stores plus a byte swap.
+// Nothing is copied, so a packet can be written straight into a slot of a sendmmsg() batch or
+// read straight out of a receive ring. Everything that doesn't need the checksum code is constexpr,
+// so packets can also be built at compile time (see the static_assert at the end).
+//
+// TCP options: MSS, window scale, SACK-permitted and timestamps, laid out like Linux does it
+// (MSS, SACK-permitted + timestamps, NOP + window scale), padded to a multiple of 4 bytes.
+
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "checksum.h"
+
+namespace packet {
+
+constexpr size_t IP_HEADER_LEN = 20;  // without IP options, which are never sent
+constexpr size_t TCP_HEADER_LEN = 20;  // without TCP options
+constexpr size_t TCP_MAX_OPTIONS_LEN = 40;
+constexpr uint8_t PROTO_TCP = 6;
+
+// TCP flags, as in byte 13 of the header
+constexpr uint8_t FIN = 0x01;
+constexpr uint8_t SYN = 0x02;
+constexpr uint8_t RST = 0x04;
+constexpr uint8_t PSH = 0x08;
+constexpr uint8_t ACK = 0x10;
+
+// TCP option kinds (RFC 9293, RFC 7323, RFC 2018)
+constexpr uint8_t OPT_EOL = 0;
+constexpr uint8_t OPT_NOP = 1;
+constexpr uint8_t OPT_MSS = 2;
+constexpr uint8_t OPT_WSCALE = 3;
+constexpr uint8_t OPT_SACK_PERMITTED = 4;
+constexpr uint8_t OPT_TIMESTAMPS = 8;
+
+constexpr uint16_t load16(const uint8_t *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+constexpr uint32_t load32(const uint8_t *p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+constexpr void store16(uint8_t *p, uint16_t v) { p[0] = v >> 8; p[1] = (uint8_t)v; }
+constexpr void store32(uint8_t *p, uint32_t v) { p[0] = v >> 24; p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v; }
+
+// Sequence number comparisons modulo 2^32 (RFC 9293, section 3.4).
+constexpr bool seq_before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+constexpr bool seq_after(uint32_t a, uint32_t b) { return (int32_t)(b - a) < 0; }
+
+// Addresses and ports are in host byte order everywhere in this header.
+class IpView {
+public:
+    constexpr explicit IpView(uint8_t *data) : p(data) {}
+
+    constexpr uint8_t version() const { return p[0] >> 4; }
+    constexpr size_t header_length() const { return (p[0] & 0x0f) * 4; }
+    constexpr uint16_t total_length() const { return load16(p + 2); }
+    constexpr uint16_t id() const { return load16(p + 4); }
+    constexpr bool is_fragment() const { return (load16(p + 6) & 0x3fff) != 0; }  // MF set or an offset
+    constexpr uint8_t ttl() const { return p[8]; }
+    constexpr uint8_t protocol() const { return p[9]; }
+    constexpr uint32_t saddr() const { return load32(p + 12); }
+    constexpr uint32_t daddr() const { return load32(p + 16); }
+    constexpr uint8_t *payload() const { return p + header_length(); }
+    constexpr uint8_t *data() const { return p; }
+
+    constexpr void set_header_length(size_t len) { p[0] = (uint8_t)(4 << 4 | len / 4); }
+    constexpr void set_total_length(uint16_t len) { store16(p + 2, len); }
+    constexpr void set_id(uint16_t id) { store16(p + 4, id); }
+    constexpr void set_ttl(uint8_t ttl) { p[8] = ttl; }
+    constexpr void set_protocol(uint8_t protocol) { p[9] = protocol; }
+    constexpr void set_saddr(uint32_t addr) { store32(p + 12, addr); }
+    constexpr void set_daddr(uint32_t addr) { store32(p + 16, addr); }
+
+    struct iphdr *header() const { return (struct iphdr *)p; }
+    void update_checksum() const { set_ip_checksum(header()); }
+
+private:
+    uint8_t *p;
+};
+
+class TcpView {
+public:
+    constexpr explicit TcpView(uint8_t *data) : p(data) {}
+
+    constexpr uint16_t source() const { return load16(p); }
+    constexpr uint16_t dest() const { return load16(p + 2); }
+    constexpr uint32_t seq() const { return load32(p + 4); }
+    constexpr uint32_t ack_seq() const { return load32(p + 8); }
+    constexpr size_t header_length() const { return (p[12] >> 4) * 4; }
+    constexpr uint8_t flags() const { return p[13]; }
+    constexpr bool has(uint8_t flag) const { return (p[13] & flag) == flag; }
+    constexpr uint16_t window() const { return load16(p + 14); }
+    constexpr uint8_t *options() const { return p + TCP_HEADER_LEN; }
+    constexpr size_t options_length() const { return header_length() - TCP_HEADER_LEN; }
+    constexpr uint8_t *payload() const { return p + header_length(); }
+    constexpr uint8_t *data() const { return p; }
+
+    constexpr void set_source(uint16_t port) { store16(p, port); }
+    constexpr void set_dest(uint16_t port) { store16(p + 2, port); }
+    constexpr void set_seq(uint32_t seq) { store32(p + 4, seq); }
+    constexpr void set_ack_seq(uint32_t ack) { store32(p + 8, ack); }
+    constexpr void set_header_length(size_t len) { p[12] = (uint8_t)(len / 4 << 4); }
+    constexpr void set_flags(uint8_t flags) { p[13] = flags; }
+    constexpr void set_window(uint16_t window) { store16(p + 14, window); }
+
+    struct tcphdr *header() const { return (struct tcphdr *)p; }
+    // The IP header must be complete (addresses) for the pseudo header.
+    void update_checksum(const IpView &ip, size_t tcp_len) const { set_tcp_checksum(ip.header(), header(), tcp_len); }
+
+private:
+    uint8_t *p;
+};
+
+struct TcpOptions {
+    uint16_t mss = 0;            // 0: no MSS option
+    int8_t wscale = -1;          // -1: no window scale option, else the shift count (0-14)
+    bool sack_permitted = false;
+    bool timestamps = false;
+    uint32_t ts_val = 0;
+    uint32_t ts_ecr = 0;
+};
+
+// Bytes the options take in the header, padding included.
+constexpr size_t tcp_options_length(const TcpOptions &options) {
+    size_t len = 0;
+    if (options.mss)
+        len += 4;
+    if (options.timestamps)
+        len += 12;  // SACK-permitted (or NOP NOP) + timestamps
+    else if (options.sack_permitted)
+        len += 4;   // NOP NOP SACK-permitted
+    if (options.wscale >= 0)
+        len += 4;   // NOP window scale
+    return len;
+}
+
+// Writes the options, returns their length (a multiple of 4).
+constexpr size_t write_tcp_options(uint8_t *p, const TcpOptions &options) {
+    size_t len = 0;
+    if (options.mss) {
+        p[len++] = OPT_MSS;
+        p[len++] = 4;
+        store16(p + len, options.mss);
+        len += 2;
+    }
+    if (options.timestamps) {
+        if (options.sack_permitted) {
+            p[len++] = OPT_SACK_PERMITTED;
+            p[len++] = 2;
+        } else {
+            p[len++] = OPT_NOP;
+            p[len++] = OPT_NOP;
+        }
+        p[len++] = OPT_TIMESTAMPS;
+        p[len++] = 10;
+        store32(p + len, options.ts_val);
+        store32(p + len + 4, options.ts_ecr);
+        len += 8;
+    } else if (options.sack_permitted) {
+        p[len++] = OPT_NOP;
+        p[len++] = OPT_NOP;
+        p[len++] = OPT_SACK_PERMITTED;
+        p[len++] = 2;
+    }
+    if (options.wscale >= 0) {
+        p[len++] = OPT_NOP;
+        p[len++] = OPT_WSCALE;
+        p[len++] = 3;
+        p[len++] = (uint8_t)options.wscale;
+    }
+    return len;
+}
+
+// Parses the options of a segment. Unknown options are skipped, a malformed one ends the parsing.
+constexpr TcpOptions parse_tcp_options(const uint8_t *p, size_t len) {
+    TcpOptions options;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t kind = p[i];
+        if (kind == OPT_EOL)
+            break;
+        if (kind == OPT_NOP) {
+            i++;
+            continue;
+        }
+        if (i + 1 >= len || p[i + 1] < 2 || i + p[i + 1] > len)
+            break;
+        uint8_t opt_len = p[i + 1];
+        if (kind == OPT_MSS && opt_len == 4)
+            options.mss = load16(p + i + 2);
+        else if (kind == OPT_WSCALE && opt_len == 3)
+            options.wscale = (int8_t)(p[i + 2] > 14 ? 14 : p[i + 2]);  // RFC 7323: larger shifts are treated as 14
+        else if (kind == OPT_SACK_PERMITTED && opt_len == 2)
+            options.sack_permitted = true;
+        else if (kind == OPT_TIMESTAMPS && opt_len == 10) {
+            options.timestamps = true;
+            options.ts_val = load32(p + i + 2);
+            options.ts_ecr = load32(p + i + 6);
+        }
+        i += opt_len;
+    }
+    return options;
+}
+
+// Everything needed to build one segment.
+struct Segment {
+    uint32_t saddr = 0;
+    uint32_t daddr = 0;
+    uint16_t source = 0;
+    uint16_t dest = 0;
+    uint32_t seq = 0;
+    uint32_t ack_seq = 0;
+    uint8_t flags = 0;
+    uint16_t window = 0;
+    uint16_t ip_id = 0;
+    uint8_t ttl = 64;
+    TcpOptions options;
+    size_t payload_length = 0;
+};
+
+constexpr size_t segment_length(const Segment &segment) {
+    return IP_HEADER_LEN + TCP_HEADER_LEN + tcp_options_length(segment.options) + segment.payload_length;
+}
+
+// Writes the IP and TCP headers (and options) into buf, which must hold segment_length() bytes.
+// Checksums are left at zero and the payload area is untouched. Returns the packet length.
+constexpr size_t write_headers(uint8_t *buf, const Segment &segment) {
+    size_t tcp_header_len = TCP_HEADER_LEN + tcp_options_length(segment.options);
+    for (size_t i = 0; i < IP_HEADER_LEN + TCP_HEADER_LEN; ++i)
+        buf[i] = 0;
+
+    IpView ip(buf);
+    ip.set_header_length(IP_HEADER_LEN);
+    ip.set_total_length((uint16_t)(IP_HEADER_LEN + tcp_header_len + segment.payload_length));
+    ip.set_id(segment.ip_id);
+    ip.set_ttl(segment.ttl);
+    ip.set_protocol(PROTO_TCP);
+    ip.set_saddr(segment.saddr);
+    ip.set_daddr(segment.daddr);
+
+    TcpView tcp(buf + IP_HEADER_LEN);
+    tcp.set_source(segment.source);
+    tcp.set_dest(segment.dest);
+    tcp.set_seq(segment.seq);
+    tcp.set_ack_seq(segment.ack_seq);
+    tcp.set_header_length(tcp_header_len);
+    tcp.set_flags(segment.flags);
+    tcp.set_window(segment.window);
+    write_tcp_options(tcp.options(), segment.options);
+    return IP_HEADER_LEN + tcp_header_len + segment.payload_length;
+}
+
+// Builds a complete packet in place: headers, optional payload and both checksums.
+inline size_t build_segment(uint8_t *buf, const Segment &segment, const void *payload = nullptr) {
+    size_t len = write_headers(buf, segment);
+    IpView ip(buf);
+    TcpView tcp(ip.payload());
+    if (payload && segment.payload_length)
+        memcpy(tcp.payload(), payload, segment.payload_length);
+    ip.update_checksum();
+    tcp.update_checksum(ip, len - IP_HEADER_LEN);
+    return len;
+}
+
+// Changes a 16 or 32-bit field of a packet with a valid checksum and patches the checksum (RFC 1624)
+// instead of recomputing it. check points at the checksum field the value is covered by.
+inline void patch16(uint8_t *field, uint16_t value, uint8_t *check) {
+    uint16_t old_raw, new_raw = htons(value), sum;
+    memcpy(&old_raw, field, 2);
+    memcpy(&sum, check, 2);
+    sum = csum_update16(sum, old_raw, new_raw);
+    memcpy(check, &sum, 2);
+    memcpy(field, &new_raw, 2);
+}
+
+inline void patch32(uint8_t *field, uint32_t value, uint8_t *check) {
+    uint32_t old_raw, new_raw = htonl(value);
+    uint16_t sum;
+    memcpy(&old_raw, field, 4);
+    memcpy(&sum, check, 2);
+    sum = csum_update32(sum, old_raw, new_raw);
+    memcpy(check, &sum, 2);
+    memcpy(field, &new_raw, 4);
+}
+
+// Offsets of the fields the load generator patches, for patch16/patch32.
+constexpr size_t IP_CHECK = 10;
+constexpr size_t IP_SADDR = 12;
+constexpr size_t TCP_SOURCE = 0;
+constexpr size_t TCP_SEQ = 4;
+constexpr size_t TCP_ACK_SEQ = 8;
+constexpr size_t TCP_CHECK = 16;
+
+// Compile-time check of the builder: a SYN with every option, built into a std::array.
+constexpr std::array<uint8_t, 60> example_syn() {
+    std::array<uint8_t, 60> buf{};
+    Segment segment;
+    segment.saddr = 0x7f000001;
+    segment.daddr = 0x7f000001;
+    segment.source = 54321;
+    segment.dest = 12345;
+    segment.seq = 200;
+    segment.flags = SYN;
+    segment.window = 65535;
+    segment.options.mss = 1460;
+    segment.options.wscale = 7;
+    segment.options.sack_permitted = true;
+    segment.options.timestamps = true;
+    segment.options.ts_val = 1;
+    write_headers(buf.data(), segment);
+    return buf;
+}
+static_assert(seq_before(0xfffffff0, 0x10) && seq_after(0x10, 0xfffffff0), "sequence numbers wrap around");
+static_assert(example_syn()[0] == 0x45 && example_syn()[33] == SYN && example_syn()[32] == 0xa0 &&
+                  example_syn()[40] == OPT_MSS && example_syn()[44] == OPT_SACK_PERMITTED &&
+                  example_syn()[57] == OPT_WSCALE,
+              "packet builder layout");
+
+}  // namespace packet
+
+#endif
@@ -0,0 +1,54 @@
+// Classic BPF socket filters for the raw sockets of server.cpp and client.cpp.
+//
+// A raw IPPROTO_TCP socket gets a copy of every TCP packet on the host. With a filter attached
+// (SO_ATTACH_FILTER) the kernel runs it on each packet and only queues the ones it accepts, so
+// unrelated traffic is neither copied to the socket nor read by the program.
+// The filters start at the IP header, which is where both a raw socket and an AF_PACKET
+// SOCK_DGRAM socket present the packet.
+
+#ifndef PACKET_FILTER_H
+#define PACKET_FILTER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+
+enum PortField {
+    MATCH_SOURCE_PORT = 0,  // offset of the port in the TCP header
+    MATCH_DEST_PORT = 2
+};
+
+// Accepts unfragmented TCP packets whose source or destination port is port. With skip_outgoing
+// (packet sockets only) packets the host sends are dropped as well, so a loopback packet is seen once.
+inline bool attach_tcp_port_filter(int sock, PortField field, uint16_t port, bool skip_outgoing = false) {
+    struct sock_filter code[] = {
+        // Load the packet type, drop outgoing packets (skipped unless skip_outgoing)
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_PKTTYPE)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 8, 0),
+        // IP protocol must be TCP
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, 0, 6),
+        // Only the first fragment carries the TCP header, drop the others
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+        // X = IP header length, then load the port from the TCP header
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, (uint32_t)field),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff),  // accept the whole packet
+        BPF_STMT(BPF_RET | BPF_K, 0),           // drop
+    };
+    struct sock_fprog program;
+    program.filter = skip_outgoing ? code : code + 2;
+    program.len = skip_outgoing ? sizeof(code) / sizeof(code[0]) : sizeof(code) / sizeof(code[0]) - 2;
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        perror("setsockopt(SO_ATTACH_FILTER) failed");
+        return false;
+    }
+    return true;
+}
+
+#endif
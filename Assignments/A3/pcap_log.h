@@ -0,0 +1,255 @@
+// Packet capture for server.cpp and client.cpp: --pcap <file> logs every packet a program sends or
+// receives to a pcap file, and PcapReader reads captures back (server --replay).
+//
+// Logging must not slow the receive loop down, so log() only copies the first PCAP_SNAPLEN bytes of
+// the packet into a ring of fixed-size slots, and a background thread turns the slots into pcap
+// records. The ring has one producer (the thread that sends and receives) and one consumer (the
+// writer), so two counters are all the synchronization it needs: the producer fills the slot at head
+// and publishes it by advancing head (release), the writer reads the slots up to head (acquire) and
+// frees them by advancing tail. When the writer falls behind and the ring is full, packets are counted
+// as dropped instead of making the producer wait.
+//
+// The file is classic pcap with nanosecond timestamps and link type LINKTYPE_RAW (packets start at
+// the IP header), which tcpdump and Wireshark read. The reader also takes microsecond timestamps,
+// either byte order and Ethernet or Linux cooked captures, so `tcpdump -i lo -w` output replays too.
+
+#ifndef PCAP_LOG_H
+#define PCAP_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PCAP_SNAPLEN 128  // bytes kept of each packet: IP and TCP headers with all their options
+#define PCAP_RING_SLOTS 32768  // packets the ring holds, a power of two
+#define PCAP_WRITER_IDLE_US 1000  // the writer sleeps this long when the ring is empty
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+
+struct PcapFileHeader {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct PcapRecordHeader {
+    uint32_t ts_sec;
+    uint32_t ts_frac;  // nanoseconds or microseconds, depending on the magic
+    uint32_t caplen;   // bytes in the file
+    uint32_t len;      // bytes on the wire
+};
+
+class PacketLog {
+public:
+    ~PacketLog() {
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+        if (fflush(file) != 0 || ferror(file))
+            perror("Writing the packet capture failed");
+        fclose(file);
+    }
+
+    // Copies the packet (an IP packet of len bytes, of which only available may have been received)
+    // into the ring. Only one thread may log.
+    void log(const void *data, size_t len, size_t available = SIZE_MAX) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail_seen >= PCAP_RING_SLOTS) {
+            tail_seen = tail.load(std::memory_order_acquire);  // only reread when the ring looks full
+            if (h - tail_seen >= PCAP_RING_SLOTS) {
+                dropped++;
+                return;
+            }
+        }
+        Slot &slot = slots[h & (PCAP_RING_SLOTS - 1)];
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        slot.ts_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        slot.len = (uint32_t)len;
+        slot.caplen = (uint32_t)std::min({len, available, (size_t)PCAP_SNAPLEN});
+        memcpy(slot.data, data, slot.caplen);
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    uint64_t logged() const { return head.load(std::memory_order_relaxed) - dropped; }
+    uint64_t lost() const { return dropped; }
+
+    friend std::unique_ptr<PacketLog> open_packet_log(const std::string &path);
+
+private:
+    struct Slot {
+        uint64_t ts_ns;
+        uint32_t len;
+        uint32_t caplen;
+        uint8_t data[PCAP_SNAPLEN];
+    };
+
+    explicit PacketLog(FILE *file) : file(file), slots(PCAP_RING_SLOTS) {
+        writer = std::thread(&PacketLog::write_loop, this);
+    }
+
+    // Writes the published slots out until the log is closed and the ring is empty.
+    void write_loop() {
+        while (true) {
+            bool stop = stopping.load(std::memory_order_acquire);  // checked before head, so nothing logged before is missed
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            uint64_t h = head.load(std::memory_order_acquire);
+            for (; t != h; ++t) {
+                const Slot &slot = slots[t & (PCAP_RING_SLOTS - 1)];
+                PcapRecordHeader record{(uint32_t)(slot.ts_ns / 1000000000), (uint32_t)(slot.ts_ns % 1000000000),
+                                        slot.caplen, slot.len};
+                fwrite(&record, sizeof(record), 1, file);
+                fwrite(slot.data, 1, slot.caplen, file);
+                if ((t & 1023) == 1023)  // free slots as it goes, a full ring can take a while
+                    tail.store(t + 1, std::memory_order_release);
+            }
+            tail.store(t, std::memory_order_release);
+            if (stop)
+                return;
+            fflush(file);
+            std::this_thread::sleep_for(std::chrono::microseconds(PCAP_WRITER_IDLE_US));
+        }
+    }
+
+    FILE *file;
+    std::vector<Slot> slots;
+    alignas(64) std::atomic<uint64_t> head{0};  // next slot the producer fills
+    uint64_t tail_seen = 0;  // the producer's last look at tail
+    uint64_t dropped = 0;
+    alignas(64) std::atomic<uint64_t> tail{0};  // next slot the writer reads
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+};
+
+// Creates the capture file and starts its writer. Returns nullptr if the file can't be created.
+inline std::unique_ptr<PacketLog> open_packet_log(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        perror(("Can't create " + path).c_str());
+        return nullptr;
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    PcapFileHeader header{PCAP_MAGIC_NS, 2, 4, 0, 0, PCAP_SNAPLEN, LINKTYPE_RAW};
+    fwrite(&header, sizeof(header), 1, file);
+    return std::unique_ptr<PacketLog>(new PacketLog(file));
+}
+
+struct PcapPacket {
+    const uint8_t *data;  // the IP header
+    uint32_t caplen;      // bytes available from data on
+    uint32_t len;         // bytes the IP packet had on the wire
+    uint64_t ts_ns;       // capture time, nanoseconds since the epoch
+};
+
+// Reads a capture mapped into memory, so the packets can be handed out in place.
+class PcapReader {
+public:
+    ~PcapReader() {
+        if (map)
+            munmap((void *)map, size);
+    }
+
+    bool open(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            perror(("Can't open " + path).c_str());
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+        size = st.st_size;
+        void *mapped = size >= sizeof(PcapFileHeader) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            fprintf(stderr, "%s is not a pcap file\n", path.c_str());
+            size = 0;
+            return false;
+        }
+        map = (const uint8_t *)mapped;
+
+        PcapFileHeader header;
+        memcpy(&header, map, sizeof(header));
+        swapped = header.magic == __builtin_bswap32(PCAP_MAGIC_US) || header.magic == __builtin_bswap32(PCAP_MAGIC_NS);
+        uint32_t magic = swapped ? __builtin_bswap32(header.magic) : header.magic;
+        linktype = field(header.linktype) & 0xFFFF;
+        if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) {
+            fprintf(stderr, "%s is not a pcap file (pcapng isn't supported)\n", path.c_str());
+            return false;
+        }
+        if (linktype != LINKTYPE_RAW && linktype != LINKTYPE_IPV4 && linktype != LINKTYPE_ETHERNET &&
+            linktype != LINKTYPE_LINUX_SLL) {
+            fprintf(stderr, "%s: link type %u isn't supported\n", path.c_str(), linktype);
+            return false;
+        }
+        nanoseconds = magic == PCAP_MAGIC_NS;
+        offset = sizeof(header);
+        return true;
+    }
+
+    // The next IPv4 packet of the capture, false at the end. Other protocols are skipped.
+    bool next(PcapPacket &packet) {
+        PcapRecordHeader record;
+        while (offset + sizeof(record) <= size) {
+            memcpy(&record, map + offset, sizeof(record));
+            uint32_t caplen = field(record.caplen);
+            const uint8_t *data = map + offset + sizeof(record);
+            offset += sizeof(record) + caplen;
+            if (offset > size)
+                break;  // cut off at the end of the file
+            size_t link = link_header_length(data, caplen);
+            if (link == SIZE_MAX || caplen < link + 20 || (data[link] >> 4) != 4) {
+                skipped++;
+                continue;
+            }
+            packet.data = data + link;
+            packet.caplen = caplen - link;
+            packet.len = field(record.len) - link;
+            packet.ts_ns = field(record.ts_sec) * 1000000000ULL + field(record.ts_frac) * (nanoseconds ? 1 : 1000);
+            return true;
+        }
+        return false;
+    }
+
+    uint64_t skipped = 0;  // records that weren't IPv4
+
+private:
+    uint32_t field(uint32_t value) const { return swapped ? __builtin_bswap32(value) : value; }
+
+    // Bytes before the IP header, SIZE_MAX if the frame doesn't carry IPv4.
+    size_t link_header_length(const uint8_t *data, uint32_t caplen) const {
+        if (linktype == LINKTYPE_ETHERNET)  // ethertype at 12
+            return caplen >= 14 && data[12] == 0x08 && data[13] == 0x00 ? 14 : SIZE_MAX;
+        if (linktype == LINKTYPE_LINUX_SLL)  // protocol at 14
+            return caplen >= 16 && data[14] == 0x08 && data[15] == 0x00 ? 16 : SIZE_MAX;
+        return 0;
+    }
+
+    const uint8_t *map = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    bool swapped = false;
+    bool nanoseconds = false;
+    uint32_t linktype = 0;
+};
+
+#endif
@@ -1,112 +1,928 @@
 #include <iostream>
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <csignal>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include "packet_filter.h"
+#include "packet.h"
+#include "pcap_log.h"
 
 #define SERVER_PORT 12345  // Listening port
+#define SYN_TIMEOUT_MS 3000  // Half-open connections older than this are evicted
+#define MAX_HALF_OPEN 65536  // Most half-open connections tracked at once
+#define SWEEP_INTERVAL_MS 100  // How often stale entries are looked for when no packet arrives
+#define RCVBUF_SIZE (8 << 20)  // Socket receive buffer, large enough to absorb bursts of SYNs
+#define COOKIE_PERIOD_S 64  // SYN cookies carry a counter that advances this often
+#define COOKIE_MAX_AGE 1  // Counter periods a cookie stays valid after the one it was made in
+#define DEFAULT_MSS 536  // MSS assumed when the SYN has no MSS option (RFC 9293)
+#define SERVER_MSS 1460  // MSS announced in the SYN-ACK
+#define SERVER_WSCALE 7  // Window scale announced in the SYN-ACK when the client offers scaling
+#define SERVER_WINDOW 65535  // Window of the SYN-ACK (never scaled, RFC 7323)
+#define RCV_WINDOW (4 << 20)  // Receive window of established connections; data is consumed on arrival
+#define IDLE_TIMEOUT_MS 10000  // Established connections silent for this long are dropped
+#define RX_BATCH 64  // Packets received per recvmmsg() call
+#define RX_SNAPLEN 2048  // Bytes kept of each packet by recvmmsg(), the headers are all we look at
+#define RING_BLOCK_SIZE (1 << 20)  // TPACKET_V3 ring: size of one block of packets
+#define RING_BLOCK_COUNT 16  // and number of blocks
+#define RING_FRAME_SIZE 2048  // Frame size the kernel uses to size the ring
+#define RING_RETIRE_MS 10  // A partly filled block is handed over after this long
 
-void print_tcp_flags(struct tcphdr *tcp) {
+// MSS values a SYN cookie can encode (2 bits), the client's MSS is rounded down to one of them
+static const uint16_t cookie_mss_table[] = {536, 1300, 1440, 1460};
+
+// A connection is identified by its 4-tuple, as seen from the client (source = client).
+struct FlowKey {
+    uint32_t saddr;
+    uint32_t daddr;
+    uint16_t source;
+    uint16_t dest;
+
+    bool operator==(const FlowKey &other) const {
+        return saddr == other.saddr && daddr == other.daddr && source == other.source && dest == other.dest;
+    }
+};
+
+uint64_t mix64(uint64_t x) {  // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+struct FlowKeyHash {
+    size_t operator()(const FlowKey &key) const {
+        uint64_t addrs = ((uint64_t)key.saddr << 32) | key.daddr;
+        uint64_t ports = ((uint64_t)key.source << 16) | key.dest;
+        return mix64(addrs ^ mix64(ports));
+    }
+};
+
+// State kept between the SYN and the final ACK.
+struct HalfOpen {
+    uint32_t client_isn;
+    uint32_t server_isn;
+    uint64_t created_ms;
+    packet::TcpOptions client_options;  // what the SYN offered, to answer retransmissions the same way
+};
+
+// An established connection. The server receives data on it and acknowledges it, it sends none.
+struct Connection {
+    uint32_t rcv_nxt = 0;        // next sequence number expected from the client
+    uint32_t snd_nxt = 0;        // the server's next sequence number (ISN + 1, one more after its FIN)
+    uint64_t received = 0;       // bytes received in order, the stream offset of rcv_nxt
+    int8_t rcv_wscale = 0;       // shift of the windows announced (0 without window scaling)
+    bool timestamps = false;     // timestamps were negotiated
+    uint32_t ts_recent = 0;      // timestamp to echo (RFC 7323)
+    bool ack_pending = false;    // an ACK is owed, sent after the receive call
+    bool fin_received = false;
+    uint64_t last_ms = 0;        // when the last segment arrived
+    std::map<uint64_t, uint64_t> out_of_order;  // stream offsets [start, end) received beyond rcv_nxt
+};
+
+enum RxMode {
+    RX_RECVFROM,  // one recvfrom() per packet
+    RX_MMSG,      // recvmmsg(), up to RX_BATCH packets per call
+    RX_RING       // PACKET_MMAP TPACKET_V3 ring, packets are read straight from shared memory
+};
+
+struct ServerOptions {
+    RxMode rx_mode = RX_RECVFROM;
+    bool quiet = false;                    // no per-packet output, print statistics every second instead
+    bool syn_cookies = false;              // stateless handshakes, nothing is stored before the final ACK
+    bool filter = true;                    // let the kernel drop packets not sent to SERVER_PORT (BPF)
+    bool verify_checksums = false;         // drop packets whose TCP checksum is wrong
+    uint64_t syn_timeout_ms = SYN_TIMEOUT_MS;
+    size_t max_half_open = MAX_HALF_OPEN;
+    std::string pcap_path;                 // capture of the packets received and sent, if set
+    std::string replay_path;               // process this capture instead of the network, if set
+    int replay_passes = 1;
+};
+
+struct ServerStats {
+    uint64_t syns = 0;         // SYNs received, retransmissions included
+    uint64_t completed = 0;    // handshakes completed by a valid final ACK
+    uint64_t evicted = 0;      // half-open connections that timed out
+    uint64_t dropped = 0;      // SYNs dropped because the table was full
+    uint64_t bad_acks = 0;     // ACKs that matched no half-open connection (or carried an invalid cookie)
+    uint64_t bad_checksums = 0;  // packets dropped by --verify-checksums
+    uint64_t data_bytes = 0;   // bytes received in order on established connections
+    uint64_t out_of_order = 0; // data segments that arrived beyond a hole
+    uint64_t duplicates = 0;   // data segments received before
+    uint64_t acks_sent = 0;    // ACKs sent for data
+    uint64_t packets = 0;      // packets received, all TCP traffic on the host included
+    uint64_t rx_calls = 0;     // system calls made to receive them
+    uint64_t cpu_us = 0;       // user + system CPU time of the process, updated at each report
+};
+
+// The server ISNs of a replayed capture, taken from its SYN-ACKs, for one 4-tuple in capture order.
+struct ReplayIsns {
+    std::vector<uint32_t> isns;
+    size_t next = 0;
+};
+
+struct HandshakeServer {
+    int sock = -1;  // -1 while replaying: replies are built and logged but not sent
+    ServerOptions options;
+    uint64_t secret = 0;  // key of the sequence number generator
+    std::unordered_map<FlowKey, HalfOpen, FlowKeyHash> half_open;
+    std::deque<std::pair<FlowKey, uint64_t>> expiry;  // (connection, created_ms) in creation order
+    std::unordered_map<FlowKey, Connection, FlowKeyHash> established;
+    std::vector<FlowKey> pending_acks;  // connections with ack_pending set
+    uint64_t last_idle_sweep_ms = 0;
+    ServerStats stats;
+    ServerStats reported;  // stats at the last report
+    uint64_t last_report_ms = 0;
+    std::unique_ptr<PacketLog> capture;
+    std::unordered_map<FlowKey, ReplayIsns, FlowKeyHash> replay_isns;
+};
+
+// Set by SIGINT and SIGTERM: the receive loop ends so the capture is written out completely.
+volatile std::sig_atomic_t stop_requested = 0;
+
+uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// RFC 6528: ISN = M + F(4-tuple, secret), M being a clock ticking every 4 microseconds, so the
+// numbers are hard to predict from outside and new incarnations of a connection move forward.
+uint32_t generate_isn(const HandshakeServer &server, const FlowKey &key) {
+    uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    return (uint32_t)(usec / 4) + (uint32_t)mix64(FlowKeyHash()(key) ^ server.secret);
+}
+
+// The ISN of a new half-open connection. A replay reuses the ISNs of the capture, so the client's
+// ACKs in it still acknowledge the right sequence number.
+uint32_t new_isn(HandshakeServer &server, const FlowKey &key) {
+    auto it = server.replay_isns.find(key);
+    if (it != server.replay_isns.end() && it->second.next < it->second.isns.size())
+        return it->second.isns[it->second.next++];
+    return generate_isn(server, key);
+}
+
+// SYN cookie layout (the server ISN): | counter (8 bits) | MAC (22 bits) | MSS index (2 bits) |
+// The MAC is a keyed hash of the 4-tuple and the counter. The client's ISN isn't covered because
+// this assignment's client doesn't send ISN + 1 in its final ACK.
+uint32_t cookie_mac(const HandshakeServer &server, const FlowKey &key, uint32_t counter) {
+    return (uint32_t)mix64(FlowKeyHash()(key) ^ mix64(server.secret + counter)) & 0x3FFFFF;
+}
+
+uint32_t cookie_counter(uint64_t now) {
+    return (uint32_t)(now / 1000 / COOKIE_PERIOD_S) & 0xFF;
+}
+
+uint32_t make_cookie(const HandshakeServer &server, const FlowKey &key, uint16_t mss, uint64_t now) {
+    uint32_t mss_index = 0;
+    for (uint32_t i = 0; i < sizeof(cookie_mss_table) / sizeof(cookie_mss_table[0]); ++i) {
+        if (cookie_mss_table[i] <= mss)
+            mss_index = i;
+    }
+    uint32_t counter = cookie_counter(now);
+    return (counter << 24) | (cookie_mac(server, key, counter) << 2) | mss_index;
+}
+
+// Returns the MSS encoded in the cookie, or 0 if the cookie is invalid or too old.
+uint16_t check_cookie(const HandshakeServer &server, const FlowKey &key, uint32_t cookie, uint64_t now) {
+    uint32_t counter = cookie >> 24;
+    if (((cookie_counter(now) - counter) & 0xFF) > COOKIE_MAX_AGE)
+        return 0;
+    if (((cookie >> 2) & 0x3FFFFF) != cookie_mac(server, key, counter))
+        return 0;
+    return cookie_mss_table[cookie & 3];
+}
+
+void print_tcp_flags(const packet::TcpView &tcp) {
     std::cout << "[+] TCP Flags: "
-              << " SYN: " << tcp->syn
-              << " ACK: " << tcp->ack
-              << " FIN: " << tcp->fin
-              << " RST: " << tcp->rst
-              << " PSH: " << tcp->psh
-              << " SEQ: " << ntohl(tcp->seq) << std::endl;
-}
-
-void send_syn_ack(int sock, struct sockaddr_in *client_addr, struct tcphdr *tcp) {
-    char packet[sizeof(struct iphdr) + sizeof(struct tcphdr)];
-    memset(packet, 0, sizeof(packet));
-
-    struct iphdr *ip = (struct iphdr *)packet;
-    struct tcphdr *tcp_response = (struct tcphdr *)(packet + sizeof(struct iphdr));
-
-    // Fill IP header
-    ip->ihl = 5;
-    ip->version = 4;
-    ip->tos = 0;
-    ip->tot_len = htons(sizeof(packet));
-    ip->id = htons(54321);
-    ip->frag_off = 0;
-    ip->ttl = 64;
-    ip->protocol = IPPROTO_TCP;
-    ip->saddr = client_addr->sin_addr.s_addr;
-    ip->daddr = inet_addr("127.0.0.1");  // Server address
-
-    // Fill TCP header
-    tcp_response->source = tcp->dest;
-    tcp_response->dest = tcp->source;
-    tcp_response->seq = htonl(400);
-    tcp_response->ack_seq = htonl(ntohl(tcp->seq) + 1);
-    tcp_response->doff = 5;
-    tcp_response->syn = 1;
-    tcp_response->ack = 1;
-    tcp_response->window = htons(8192);
-    tcp_response->check = 0;  // Kernel will compute the checksum
-
-    // Send packet
-    if (sendto(sock, packet, sizeof(packet), 0, (struct sockaddr *)client_addr, sizeof(*client_addr)) < 0) {
+              << " SYN: " << tcp.has(packet::SYN)
+              << " ACK: " << tcp.has(packet::ACK)
+              << " FIN: " << tcp.has(packet::FIN)
+              << " RST: " << tcp.has(packet::RST)
+              << " PSH: " << tcp.has(packet::PSH)
+              << " SEQ: " << tcp.seq() << std::endl;
+}
+
+void print_tcp_options(const packet::TcpOptions &options) {
+    if (!options.mss && options.wscale < 0 && !options.sack_permitted && !options.timestamps)
+        return;
+    std::cout << "[+] TCP Options:";
+    if (options.mss)
+        std::cout << " MSS " << options.mss;
+    if (options.wscale >= 0)
+        std::cout << "  window scale " << (int)options.wscale;
+    if (options.sack_permitted)
+        std::cout << "  SACK permitted";
+    if (options.timestamps)
+        std::cout << "  timestamps " << options.ts_val << "/" << options.ts_ecr;
+    std::cout << std::endl;
+}
+
+// Sends a packet built by build_segment() and adds it to the capture. Nothing is sent while replaying.
+void send_packet(const HandshakeServer &server, const uint8_t *data, size_t len, struct sockaddr_in *dest_addr) {
+    if (server.capture)
+        server.capture->log(data, len);
+    if (server.sock >= 0 && sendto(server.sock, data, len, 0, (struct sockaddr *)dest_addr, sizeof(*dest_addr)) < 0)
         perror("sendto() failed");
-    } else {
+}
+
+// Answers a SYN. Window scaling, SACK and timestamps are only agreed to when the client offered
+// them (RFC 7323, RFC 2018); a SYN cookie has no room to remember them, so cookie mode sends the MSS alone.
+void send_syn_ack(const HandshakeServer &server, struct sockaddr_in *client_addr, const packet::IpView &ip,
+                  const packet::TcpView &tcp, uint32_t server_isn, const packet::TcpOptions &client_options) {
+    packet::Segment syn_ack;
+    syn_ack.saddr = ip.daddr();  // Server address the SYN was sent to
+    syn_ack.daddr = ip.saddr();
+    syn_ack.source = tcp.dest();
+    syn_ack.dest = tcp.source();
+    syn_ack.seq = server_isn;
+    syn_ack.ack_seq = tcp.seq() + 1;
+    syn_ack.flags = packet::SYN | packet::ACK;
+    syn_ack.window = SERVER_WINDOW;
+    syn_ack.ip_id = 54321;
+    syn_ack.options.mss = SERVER_MSS;
+    if (!server.options.syn_cookies) {
+        if (client_options.wscale >= 0)
+            syn_ack.options.wscale = SERVER_WSCALE;
+        syn_ack.options.sack_permitted = client_options.sack_permitted;
+        if (client_options.timestamps) {
+            syn_ack.options.timestamps = true;
+            syn_ack.options.ts_val = (uint32_t)now_ms();
+            syn_ack.options.ts_ecr = client_options.ts_val;
+        }
+    }
+
+    uint8_t buffer[packet::IP_HEADER_LEN + packet::TCP_HEADER_LEN + packet::TCP_MAX_OPTIONS_LEN];
+    // The kernel fills in the IP checksum (IP_HDRINCL) but not the TCP one, build_segment does both
+    size_t len = packet::build_segment(buffer, syn_ack);
+
+    send_packet(server, buffer, len, client_addr);
+    if (!server.options.quiet) {
         std::cout << "[+] Sent SYN-ACK" << std::endl;
+        print_tcp_options(syn_ack.options);
+    }
+}
+
+// Drops the half-open connections that waited longer than the SYN timeout.
+void evict_stale(HandshakeServer &server, uint64_t now) {
+    while (!server.expiry.empty() && now - server.expiry.front().second >= server.options.syn_timeout_ms) {
+        auto it = server.half_open.find(server.expiry.front().first);
+        // The entry may be gone (completed) or belong to a newer SYN of the same 4-tuple
+        if (it != server.half_open.end() && it->second.created_ms == server.expiry.front().second) {
+            server.half_open.erase(it);
+            server.stats.evicted++;
+        }
+        server.expiry.pop_front();
+    }
+}
+
+void handle_syn(HandshakeServer &server, struct sockaddr_in *source_addr, const packet::IpView &ip, const packet::TcpView &tcp,
+                const FlowKey &key, const packet::TcpOptions &client_options, uint64_t now) {
+    if (!server.options.quiet) {
+        std::cout << "[+] Received SYN from " << inet_ntoa(source_addr->sin_addr) << std::endl;
+        print_tcp_options(client_options);
+    }
+    server.established.erase(key);  // the 4-tuple is reused
+    if (server.options.syn_cookies) {
+        // Stateless: everything needed to validate the final ACK travels in the SYN-ACK's sequence number
+        uint16_t mss = client_options.mss ? client_options.mss : DEFAULT_MSS;
+        send_syn_ack(server, source_addr, ip, tcp, make_cookie(server, key, mss, now), client_options);
+        return;
+    }
+
+    auto it = server.half_open.find(key);
+    if (it == server.half_open.end()) {
+        if (server.half_open.size() >= server.options.max_half_open) {
+            server.stats.dropped++;
+            return;
+        }
+        HalfOpen entry{tcp.seq(), new_isn(server, key), now, client_options};
+        it = server.half_open.emplace(key, entry).first;
+        server.expiry.push_back({key, now});
+    } else if (it->second.client_isn != tcp.seq()) {
+        // A new connection attempt on the same 4-tuple replaces the stale one
+        it->second = HalfOpen{tcp.seq(), new_isn(server, key), now, client_options};
+        server.expiry.push_back({key, now});
+    }
+    // Otherwise it is a retransmitted SYN, answered with the same sequence number and options
+    send_syn_ack(server, source_addr, ip, tcp, it->second.server_isn, it->second.client_options);
+}
+
+// Sets up the established connection once the final ACK arrives. The client's next sequence number is
+// taken from the ACK (this assignment's client sends 600, not its ISN + 1).
+void establish(HandshakeServer &server, const FlowKey &key, const packet::TcpView &tcp, const packet::TcpOptions &client_options,
+               const packet::TcpOptions &ack_options, uint64_t now) {
+    Connection &conn = server.established[key];
+    conn.rcv_nxt = tcp.seq();
+    conn.snd_nxt = tcp.ack_seq();
+    conn.rcv_wscale = client_options.wscale >= 0 ? SERVER_WSCALE : 0;
+    conn.timestamps = client_options.timestamps && !server.options.syn_cookies;
+    conn.ts_recent = ack_options.ts_val;
+    conn.last_ms = now;
+}
+
+void handle_ack(HandshakeServer &server, const packet::TcpView &tcp, const FlowKey &key, const packet::TcpOptions &options, uint64_t now) {
+    if (server.options.syn_cookies) {
+        uint16_t mss = check_cookie(server, key, tcp.ack_seq() - 1, now);
+        if (mss == 0) {
+            server.stats.bad_acks++;
+            return;
+        }
+        // Only the MSS survives in the cookie: no window scaling or timestamps on this connection
+        establish(server, key, tcp, packet::TcpOptions(), options, now);
+        server.stats.completed++;
+        if (!server.options.quiet)
+            std::cout << "[+] Received ACK, handshake complete (cookie valid, MSS " << mss << ")." << std::endl;
+        return;
+    }
+
+    auto it = server.half_open.find(key);
+    if (it == server.half_open.end() || tcp.ack_seq() != it->second.server_isn + 1) {
+        server.stats.bad_acks++;
+        return;
+    }
+    establish(server, key, tcp, it->second.client_options, options, now);
+    server.half_open.erase(it);
+    server.stats.completed++;
+    if (!server.options.quiet)
+        std::cout << "[+] Received ACK, handshake complete." << std::endl;
+}
+
+// The receive window in bytes: RCV_WINDOW, or what fits in 16 bits without window scaling.
+uint32_t receive_window(const Connection &conn) {
+    return std::min(RCV_WINDOW >> conn.rcv_wscale, 65535) << conn.rcv_wscale;
+}
+
+// Sends an ACK (with extra flags, FIN) for everything received in order so far.
+void send_ack(HandshakeServer &server, const FlowKey &key, Connection &conn, uint8_t flags) {
+    packet::Segment ack;
+    ack.saddr = key.daddr;
+    ack.daddr = key.saddr;
+    ack.source = key.dest;
+    ack.dest = key.source;
+    ack.seq = conn.snd_nxt;
+    ack.ack_seq = conn.rcv_nxt;
+    ack.flags = packet::ACK | flags;
+    ack.window = (uint16_t)(receive_window(conn) >> conn.rcv_wscale);
+    ack.ip_id = 54321;
+    if (conn.timestamps) {
+        ack.options.timestamps = true;
+        ack.options.ts_val = (uint32_t)now_ms();
+        ack.options.ts_ecr = conn.ts_recent;
+    }
+    uint8_t buffer[packet::IP_HEADER_LEN + packet::TCP_HEADER_LEN + packet::TCP_MAX_OPTIONS_LEN];
+    size_t len = packet::build_segment(buffer, ack);
+
+    struct sockaddr_in client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_addr.s_addr = htonl(key.saddr);
+    send_packet(server, buffer, len, &client_addr);
+    server.stats.acks_sent++;
+    conn.ack_pending = false;
+}
+
+// Sends the ACKs owed after a receive call: one per connection for all the segments the call returned.
+void flush_acks(HandshakeServer &server) {
+    for (const FlowKey &key : server.pending_acks) {
+        auto it = server.established.find(key);
+        if (it != server.established.end() && it->second.ack_pending)
+            send_ack(server, key, it->second, 0);
+    }
+    server.pending_acks.clear();
+}
+
+// Receives a segment on an established connection. In-order data moves rcv_nxt and is acknowledged
+// after the receive call. Data beyond a hole is remembered and, like a duplicate, acknowledged at once,
+// so the sender sees duplicate ACKs. The client's FIN is answered with a FIN, and the ACK of that FIN
+// closes the connection.
+void handle_segment(HandshakeServer &server, const FlowKey &key, Connection &conn, const packet::IpView &ip,
+                    const packet::TcpView &tcp, const packet::TcpOptions &options, uint64_t now) {
+    uint32_t length = ip.total_length() - ip.header_length() - tcp.header_length();
+    uint32_t seq = tcp.seq(), end = seq + length;
+    bool fin = tcp.has(packet::FIN);
+    conn.last_ms = now;
+
+    if (conn.fin_received && !fin && length == 0) {
+        if (tcp.ack_seq() == conn.snd_nxt)  // our FIN is acknowledged
+            server.established.erase(key);
+        return;
+    }
+    if (length == 0 && !fin)
+        return;  // a bare ACK, the server sends no data to be acknowledged
+    if (packet::seq_after(end, conn.rcv_nxt + receive_window(conn))) {
+        send_ack(server, key, conn, 0);  // beyond the window
+        return;
+    }
+
+    if (packet::seq_after(seq, conn.rcv_nxt)) {
+        uint64_t start = conn.received + (seq - conn.rcv_nxt);
+        uint64_t &stored_end = conn.out_of_order[start];
+        stored_end = std::max(stored_end, start + length);
+        server.stats.out_of_order++;
+        send_ack(server, key, conn, 0);
+        return;
+    }
+    if (packet::seq_after(end, conn.rcv_nxt)) {
+        server.stats.data_bytes += end - conn.rcv_nxt;
+        conn.received += end - conn.rcv_nxt;
+        conn.rcv_nxt = end;
+        if (conn.timestamps && options.timestamps)
+            conn.ts_recent = options.ts_val;
+        // Pull in what arrived beyond the hole, acknowledging at once when a hole was filled
+        bool filled = !conn.out_of_order.empty();
+        while (!conn.out_of_order.empty() && conn.out_of_order.begin()->first <= conn.received) {
+            uint64_t stored_end = conn.out_of_order.begin()->second;
+            if (stored_end > conn.received) {
+                server.stats.data_bytes += stored_end - conn.received;
+                conn.rcv_nxt += (uint32_t)(stored_end - conn.received);
+                conn.received = stored_end;
+            }
+            conn.out_of_order.erase(conn.out_of_order.begin());
+        }
+        if (filled) {
+            send_ack(server, key, conn, 0);
+        } else if (!conn.ack_pending) {
+            conn.ack_pending = true;
+            server.pending_acks.push_back(key);
+        }
+    } else if (length > 0) {
+        server.stats.duplicates++;
+        send_ack(server, key, conn, 0);
+    }
+
+    // The FIN takes the sequence number after the data, it counts once everything before it arrived
+    if (fin && !conn.fin_received && end == conn.rcv_nxt) {
+        conn.rcv_nxt++;
+        conn.fin_received = true;
+        send_ack(server, key, conn, packet::FIN);
+        conn.snd_nxt++;
+    } else if (fin && conn.fin_received) {
+        conn.snd_nxt--;  // retransmitted FIN: send ours again
+        send_ack(server, key, conn, packet::FIN);
+        conn.snd_nxt++;
+    }
+}
+
+// Whether the IP and TCP header lengths of a packet are consistent with each other and with the packet:
+// raw sockets get TCP packets before the kernel's TCP has checked them, and a capture can hold anything.
+// Otherwise the segment length wraps and the options are read past the packet. captured_size bytes of
+// the packet are at ip, wire_size is its whole length.
+bool tcp_headers_valid(const packet::IpView &ip, size_t captured_size, size_t wire_size) {
+    if (captured_size < packet::IP_HEADER_LEN || ip.header_length() < packet::IP_HEADER_LEN ||
+        captured_size < ip.header_length() + packet::TCP_HEADER_LEN)
+        return false;
+    packet::TcpView tcp(ip.payload());
+    return tcp.header_length() >= packet::TCP_HEADER_LEN &&
+           ip.total_length() >= ip.header_length() + tcp.header_length() && ip.total_length() <= wire_size;
+}
+
+// Processes one received IP packet. data_size bytes of it are in buffer, out of wire_size (less with a snap length).
+void process_packet(HandshakeServer &server, char *buffer, int data_size, int wire_size, struct sockaddr_in *source_addr,
+                    uint64_t now) {
+    if (data_size < (int)packet::IP_HEADER_LEN)
+        return;
+    packet::IpView ip((uint8_t *)buffer);
+    if (ip.protocol() != packet::PROTO_TCP || !tcp_headers_valid(ip, data_size, wire_size))
+        return;
+    packet::TcpView tcp(ip.payload());
+
+    // Only process packets for the correct destination port
+    if (tcp.dest() != SERVER_PORT) return;
+    if (server.capture)
+        server.capture->log(buffer, ip.total_length(), data_size);
+
+    // Only complete segments can be checked (recvmmsg keeps the first RX_SNAPLEN bytes)
+    int ip_len = ip.total_length();
+    if (server.options.verify_checksums && ip_len <= data_size &&
+        !tcp_checksum_ok(ip.header(), tcp.header(), ip_len - ip.header_length())) {
+        server.stats.bad_checksums++;
+        return;
+    }
+
+    if (!server.options.quiet)
+        print_tcp_flags(tcp);
+
+    FlowKey key{ip.saddr(), ip.daddr(), tcp.source(), tcp.dest()};
+    // Options cut off by the snap length are ignored
+    size_t available = data_size - ip.header_length() - packet::TCP_HEADER_LEN;
+    size_t options_length = tcp.header_length() > packet::TCP_HEADER_LEN ? tcp.options_length() : 0;
+    packet::TcpOptions options = packet::parse_tcp_options(tcp.options(), std::min(options_length, available));
+    if (tcp.has(packet::SYN) && !tcp.has(packet::ACK)) {
+        server.stats.syns++;
+        handle_syn(server, source_addr, ip, tcp, key, options, now);
+    } else if (tcp.has(packet::ACK) && !tcp.has(packet::SYN) && !tcp.has(packet::RST)) {
+        auto conn = server.established.find(key);
+        if (conn != server.established.end())
+            handle_segment(server, key, conn->second, ip, tcp, options, now);
+        else
+            handle_ack(server, tcp, key, options, now);
+    }
+}
+
+// Approximate memory held for half-open connections: hash nodes, bucket array and expiry queue.
+size_t half_open_memory(const HandshakeServer &server) {
+    size_t node = sizeof(std::pair<const FlowKey, HalfOpen>) + sizeof(void *) + sizeof(size_t);
+    return server.half_open.size() * node + server.half_open.bucket_count() * sizeof(void *) +
+           server.expiry.size() * sizeof(server.expiry.front());
+}
+
+void print_stats(const HandshakeServer &server, uint64_t elapsed_ms) {
+    uint64_t packets = server.stats.packets - server.reported.packets;
+    uint64_t rx_calls = server.stats.rx_calls - server.reported.rx_calls;
+    if (elapsed_ms == 0)
+        elapsed_ms = 1;
+    std::cout << "[+] handshakes/s: " << (server.stats.completed - server.reported.completed) * 1000 / elapsed_ms
+              << "  packets/s: " << packets * 1000 / elapsed_ms
+              << "  rx calls/s: " << rx_calls * 1000 / elapsed_ms
+              << "  CPU: " << (server.stats.cpu_us - server.reported.cpu_us) / (10.0 * elapsed_ms) << "%"
+              << "  completed: " << server.stats.completed
+              << "  data: " << (server.stats.data_bytes - server.reported.data_bytes) * 8 / 1000 / elapsed_ms << " Mbit/s"
+              << "  established: " << server.established.size()
+              << "  half-open: " << server.half_open.size()
+              << " (" << half_open_memory(server) / 1024 << " KB)"
+              << "  SYNs: " << server.stats.syns
+              << "  evicted: " << server.stats.evicted
+              << "  dropped: " << server.stats.dropped
+              << "  bad ACKs: " << server.stats.bad_acks;
+    if (server.stats.data_bytes)
+        std::cout << "  out of order: " << server.stats.out_of_order << "  duplicates: " << server.stats.duplicates
+                  << "  ACKs sent: " << server.stats.acks_sent;
+    if (server.options.verify_checksums)
+        std::cout << "  bad checksums: " << server.stats.bad_checksums;
+    std::cout << std::endl;
+}
+
+// Drops the established connections that have been idle for IDLE_TIMEOUT_MS.
+void evict_idle(HandshakeServer &server, uint64_t now) {
+    for (auto it = server.established.begin(); it != server.established.end();) {
+        if (now - it->second.last_ms >= IDLE_TIMEOUT_MS)
+            it = server.established.erase(it);
+        else
+            ++it;
+    }
+    server.last_idle_sweep_ms = now;
+}
+
+// Sends the ACKs owed after a receive call and evicts stale entries.
+void maintain(HandshakeServer &server, uint64_t now) {
+    flush_acks(server);
+    evict_stale(server, now);
+    if (now - server.last_idle_sweep_ms >= 1000)
+        evict_idle(server, now);
+}
+
+void update_cpu_time(HandshakeServer &server) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    server.stats.cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Runs after every receive call: maintain(), and the statistics once a second.
+void housekeeping(HandshakeServer &server, uint64_t now) {
+    maintain(server, now);
+    if (server.options.quiet && now - server.last_report_ms >= 1000) {
+        update_cpu_time(server);
+        print_stats(server, now - server.last_report_ms);
+        server.reported = server.stats;
+        server.last_report_ms = now;
     }
 }
 
-void receive_syn() {
-    int sock = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
-    if (sock < 0) {
+void receive_recvfrom(HandshakeServer &server) {
+    char buffer[65536];
+    struct sockaddr_in source_addr;
+    socklen_t addr_len;
+
+    while (!stop_requested) {
+        addr_len = sizeof(source_addr);
+        int data_size = recvfrom(server.sock, buffer, sizeof(buffer), 0, (struct sockaddr *)&source_addr, &addr_len);
+        uint64_t now = now_ms();
+        server.stats.rx_calls++;
+        if (data_size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("Packet reception failed");
+        } else if (data_size > 0) {
+            server.stats.packets++;
+            process_packet(server, buffer, data_size, data_size, &source_addr, now);
+        }
+        housekeeping(server, now);
+    }
+}
+
+// Same as receive_recvfrom, but one recvmmsg() call returns everything queued (up to RX_BATCH packets).
+void receive_mmsg(HandshakeServer &server) {
+    std::vector<char> buffers(RX_BATCH * RX_SNAPLEN);
+    struct iovec iov[RX_BATCH];
+    struct mmsghdr msgs[RX_BATCH];
+    struct sockaddr_in source_addrs[RX_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < RX_BATCH; ++i) {
+        iov[i] = {&buffers[i * RX_SNAPLEN], RX_SNAPLEN};
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &source_addrs[i];
+    }
+
+    while (!stop_requested) {
+        for (int i = 0; i < RX_BATCH; ++i)
+            msgs[i].msg_hdr.msg_namelen = sizeof(source_addrs[i]);
+        // MSG_WAITFORONE: block (up to SO_RCVTIMEO) for the first packet only, then take what is queued.
+        // MSG_TRUNC: msg_len is the packet's whole length, even when only RX_SNAPLEN bytes were kept
+        int count = recvmmsg(server.sock, msgs, RX_BATCH, MSG_WAITFORONE | MSG_TRUNC, nullptr);
+        uint64_t now = now_ms();
+        server.stats.rx_calls++;
+        if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            perror("Packet reception failed");
+        for (int i = 0; i < count; ++i) {
+            server.stats.packets++;
+            process_packet(server, &buffers[i * RX_SNAPLEN], std::min<int>(msgs[i].msg_len, RX_SNAPLEN), msgs[i].msg_len,
+                           &source_addrs[i], now);
+        }
+        housekeeping(server, now);
+    }
+}
+
+// Receives IP packets through a TPACKET_V3 ring shared with the kernel. The kernel fills whole blocks
+// of packets and hands them over by setting TP_STATUS_USER, so a system call (poll) is only needed
+// when the ring is empty. Replies are still sent through server.sock, a send-only IPPROTO_RAW socket.
+void receive_ring(HandshakeServer &server) {
+    int ring_sock = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (ring_sock < 0) {
+        perror("Packet socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    int version = TPACKET_V3;
+    if (setsockopt(ring_sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("setsockopt(PACKET_VERSION) failed");
+        exit(EXIT_FAILURE);
+    }
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RING_BLOCK_SIZE;
+    req.tp_block_nr = RING_BLOCK_COUNT;
+    req.tp_frame_size = RING_FRAME_SIZE;
+    req.tp_frame_nr = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_COUNT;
+    req.tp_retire_blk_tov = RING_RETIRE_MS;
+    if (setsockopt(ring_sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        perror("setsockopt(PACKET_RX_RING) failed");
+        exit(EXIT_FAILURE);
+    }
+    char *ring = (char *)mmap(nullptr, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT, PROT_READ | PROT_WRITE, MAP_SHARED, ring_sock, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap() of the packet ring failed");
+        exit(EXIT_FAILURE);
+    }
+    if (server.options.filter && !attach_tcp_port_filter(ring_sock, MATCH_DEST_PORT, SERVER_PORT, true))
+        exit(EXIT_FAILURE);
+    struct sockaddr_ll bind_addr;
+    memset(&bind_addr, 0, sizeof(bind_addr));
+    bind_addr.sll_family = AF_PACKET;
+    bind_addr.sll_protocol = htons(ETH_P_IP);
+    bind_addr.sll_ifindex = 0;  // all interfaces, like the raw socket
+    if (bind(ring_sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0) {
+        perror("Packet socket bind failed");
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in source_addr;
+    memset(&source_addr, 0, sizeof(source_addr));
+    source_addr.sin_family = AF_INET;
+    int block = 0;
+
+    while (!stop_requested) {
+        struct tpacket_block_desc *desc = (struct tpacket_block_desc *)(ring + (size_t)block * RING_BLOCK_SIZE);
+        if (!(desc->hdr.bh1.block_status & TP_STATUS_USER)) {
+            struct pollfd pfd{ring_sock, POLLIN | POLLERR, 0};
+            poll(&pfd, 1, SWEEP_INTERVAL_MS);
+            server.stats.rx_calls++;
+            housekeeping(server, now_ms());
+            continue;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        uint64_t now = now_ms();
+        struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)((char *)desc + desc->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < desc->hdr.bh1.num_pkts; ++i) {
+            struct sockaddr_ll *link = (struct sockaddr_ll *)((char *)hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+            // On loopback every packet shows up twice, as sent and as received: only keep the latter
+            // (the filter already drops the sent copies, this is for --no-filter)
+            if (link->sll_pkttype != PACKET_OUTGOING) {
+                char *data = (char *)hdr + hdr->tp_net;
+                server.stats.packets++;
+                source_addr.sin_addr.s_addr = htonl(packet::IpView((uint8_t *)data).saddr());
+                process_packet(server, data, hdr->tp_snaplen, hdr->tp_len, &source_addr, now);
+            }
+            hdr = (struct tpacket3_hdr *)((char *)hdr + hdr->tp_next_offset);
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+        desc->hdr.bh1.block_status = TP_STATUS_KERNEL;  // give the block back
+        block = (block + 1) % RING_BLOCK_COUNT;
+        housekeeping(server, now);
+    }
+    munmap(ring, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT);
+    close(ring_sock);
+}
+
+void receive_syn(HandshakeServer &server) {
+    // The ring receives through its own packet socket, so the raw socket is only used to send
+    // (IPPROTO_RAW: send-only, IP header included) and doesn't get a copy of every TCP packet.
+    server.sock = socket(AF_INET, SOCK_RAW, server.options.rx_mode == RX_RING ? IPPROTO_RAW : IPPROTO_TCP);
+    if (server.sock < 0) {
         perror("Socket creation failed");
         exit(EXIT_FAILURE);
     }
 
     // Enable IP header inclusion
     int one = 1;
-    if (setsockopt(sock, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one)) < 0) {
+    if (setsockopt(server.sock, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one)) < 0) {
         perror("setsockopt() failed");
         exit(EXIT_FAILURE);
     }
 
-    char buffer[65536];
-    struct sockaddr_in source_addr;
-    socklen_t addr_len = sizeof(source_addr);
+    // Without a filter the raw socket queues every TCP packet on the host, most of them for other ports
+    if (server.options.rx_mode != RX_RING && server.options.filter &&
+        !attach_tcp_port_filter(server.sock, MATCH_DEST_PORT, SERVER_PORT))
+        exit(EXIT_FAILURE);
 
-    while (true) {
-        int data_size = recvfrom(sock, buffer, sizeof(buffer), 0, (struct sockaddr *)&source_addr, &addr_len);
-        if (data_size < 0) {
-            perror("Packet reception failed");
-            continue;
-        }
+    // A raw socket gets a copy of every TCP packet on the host, so bursts overflow the default buffer
+    int rcvbuf = RCVBUF_SIZE;
+    if (setsockopt(server.sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+        setsockopt(server.sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
 
-        struct iphdr *ip = (struct iphdr *)buffer;
-        struct tcphdr *tcp = (struct tcphdr *)(buffer + (ip->ihl * 4));
+    // Wake up regularly even without traffic so stale half-open connections are evicted
+    struct timeval timeout{0, SWEEP_INTERVAL_MS * 1000};
+    setsockopt(server.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
-        // Only process packets for the correct destination port
-        if (ntohs(tcp->dest) != SERVER_PORT) continue;
+    server.last_report_ms = now_ms();
+    if (server.options.rx_mode == RX_MMSG)
+        receive_mmsg(server);
+    else if (server.options.rx_mode == RX_RING)
+        receive_ring(server);
+    else
+        receive_recvfrom(server);
 
-        print_tcp_flags(tcp);
+    close(server.sock);
+}
 
-        if (tcp->syn == 1 && tcp->ack == 0 && ntohl(tcp->seq) == 200) {
-            std::cout << "[+] Received SYN from " << inet_ntoa(source_addr.sin_addr) << std::endl;
-            send_syn_ack(sock, &source_addr, tcp);
+// Feeds a capture to process_packet() as fast as it goes, to profile the parsing and the state machines
+// without a network or a client. The packets are handed over RX_BATCH at a time, as recvmmsg() would,
+// and the capture's timestamps are the clock, so every replay of a capture does the same work. The
+// replies are built (and captured with --pcap) but not sent. Packets the server sent itself are in a
+// capture too: process_packet() ignores them, but their ISNs are reused.
+void replay_capture(HandshakeServer &server) {
+    PcapReader reader;
+    if (!reader.open(server.options.replay_path))
+        exit(EXIT_FAILURE);
+    std::vector<PcapPacket> packets;
+    PcapPacket captured;
+    uint64_t last_ms = 0;
+    while (reader.next(captured)) {
+        packets.push_back(captured);
+        last_ms = std::max(last_ms, captured.ts_ns / 1000000);
+        packet::IpView ip((uint8_t *)captured.data);
+        if (ip.protocol() != packet::PROTO_TCP || !tcp_headers_valid(ip, captured.caplen, captured.len))
+            continue;
+        packet::TcpView tcp(ip.payload());
+        if (tcp.source() == SERVER_PORT && tcp.has(packet::SYN | packet::ACK)) {
+            std::vector<uint32_t> &isns = server.replay_isns[FlowKey{ip.daddr(), ip.saddr(), tcp.dest(), tcp.source()}].isns;
+            if (isns.empty() || isns.back() != tcp.seq())  // a retransmitted SYN gets the same ISN again
+                isns.push_back(tcp.seq());
         }
+    }
+    if (packets.empty()) {
+        std::cerr << "No IPv4 packets in " << server.options.replay_path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // Every pass starts once everything the previous one left behind has timed out
+    uint64_t pass_ms = last_ms - packets.front().ts_ns / 1000000 + std::max<uint64_t>(server.options.syn_timeout_ms, IDLE_TIMEOUT_MS) + 1000;
 
-        if (tcp->ack == 1 && tcp->syn == 0 && ntohl(tcp->seq) == 600) {
-            std::cout << "[+] Received ACK, handshake complete." << std::endl;
-            break;
+    struct sockaddr_in source_addr;
+    memset(&source_addr, 0, sizeof(source_addr));
+    source_addr.sin_family = AF_INET;
+    update_cpu_time(server);
+    server.reported = server.stats;  // the CPU time of the replay only
+    auto start = std::chrono::steady_clock::now();
+    uint64_t now = 0;
+    for (int pass = 0; pass < server.options.replay_passes && !stop_requested; ++pass) {
+        for (auto &entry : server.replay_isns)
+            entry.second.next = 0;
+        for (size_t i = 0; i < packets.size(); ++i) {
+            now = packets[i].ts_ns / 1000000 + pass * pass_ms;
+            server.stats.packets++;
+            source_addr.sin_addr.s_addr = htonl(packet::IpView((uint8_t *)packets[i].data).saddr());
+            process_packet(server, (char *)packets[i].data, packets[i].caplen, packets[i].len, &source_addr, now);
+            if (i % RX_BATCH == RX_BATCH - 1 || i + 1 == packets.size()) {
+                server.stats.rx_calls++;
+                maintain(server, now);
+            }
         }
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    close(sock);
+    std::cout << "[+] Replayed " << server.stats.packets << " packets (" << server.options.replay_passes << " x " << packets.size()
+              << ", " << reader.skipped << " non-IPv4 records skipped) in " << seconds << " s: "
+              << (uint64_t)(server.stats.packets / seconds) << " packets/s, " << seconds * 1e9 / server.stats.packets
+              << " ns per packet" << std::endl;
+    update_cpu_time(server);
+    print_stats(server, std::max<uint64_t>(1, (uint64_t)(seconds * 1000)));
 }
 
-int main() {
-    std::cout << "[+] Server listening on port " << SERVER_PORT << "..." << std::endl;
-    receive_syn();
-    return 0;
+void request_stop(int) {
+    stop_requested = 1;
 }
 
+int main(int argc, char *argv[]) {
+    HandshakeServer server;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quiet") {
+            server.options.quiet = true;
+        } else if (arg == "--verify-checksums") {
+            server.options.verify_checksums = true;
+        } else if (arg == "--no-filter") {
+            server.options.filter = false;
+        } else if (arg == "--syn-cookies") {
+            server.options.syn_cookies = true;
+        } else if (arg == "--rx" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "recvfrom") {
+                server.options.rx_mode = RX_RECVFROM;
+            } else if (mode == "mmsg") {
+                server.options.rx_mode = RX_MMSG;
+            } else if (mode == "ring") {
+                server.options.rx_mode = RX_RING;
+            } else {
+                std::cerr << "Unknown receive mode " << mode << " (recvfrom, mmsg or ring)" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--syn-timeout" && i + 1 < argc) {
+            server.options.syn_timeout_ms = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--max-half-open" && i + 1 < argc) {
+            server.options.max_half_open = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--pcap" && i + 1 < argc) {
+            server.options.pcap_path = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            server.options.replay_path = argv[++i];
+        } else if (arg == "--passes" && i + 1 < argc) {
+            server.options.replay_passes = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--quiet] [--syn-cookies] [--rx recvfrom|mmsg|ring] [--no-filter] [--verify-checksums] [--syn-timeout <ms>] [--max-half-open <n>] [--pcap <file>]\n"
+                      << "       " << argv[0] << " --replay <file> [--passes <n>] [--syn-cookies] [--verify-checksums] [--syn-timeout <ms>] [--max-half-open <n>] [--pcap <file>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    server.secret = ((uint64_t)std::random_device{}() << 32) | std::random_device{}();
+
+    // Without this a Ctrl-C would lose what is still in the capture's ring
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    if (!server.options.pcap_path.empty()) {
+        server.capture = open_packet_log(server.options.pcap_path);
+        if (!server.capture)
+            return EXIT_FAILURE;
+    }
+
+    if (!server.options.replay_path.empty()) {
+        server.options.quiet = true;  // per-packet output would be all the replay measures
+        replay_capture(server);
+    } else {
+        std::cout << "[+] Server listening on port " << SERVER_PORT << "..." << std::endl;
+        if (server.options.syn_cookies)
+            std::cout << "[+] SYN cookies enabled" << std::endl;
+        receive_syn(server);
+    }
+
+    if (server.capture) {
+        uint64_t logged = server.capture->logged(), lost = server.capture->lost();
+        server.capture.reset();  // waits for the writer to drain the ring
+        std::cout << "[+] Captured " << logged << " packets to " << server.options.pcap_path;
+        if (lost > 0)
+            std::cout << " (" << lost << " lost because the ring was full)";
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,287 @@
+// Scaling benchmark for routing_sim: generates topologies of each model and size with topology_gen,
+// runs routing_sim on them at each thread count (with --quiet, so printing isn't measured) and collects
+// the load, DVR and LSR times it reports with --timing. Every run is a row of the CSV/JSON results; the medians are
+// printed as a table, with the speedup over the first thread count.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+struct BenchOptions
+{
+    vector<string> models = {"er", "ba"};
+    vector<int> sizes = {128, 256, 512};
+    vector<int> threads = {1, 2, 4};
+    vector<string> dvrModes = {"sweep"};  // routing_sim --dvr
+    int runs = 3;                         // repetitions of each configuration
+    double degree = 4;
+    string seed = "1";
+    string simulator = "./routing_sim";
+    string generator = "./topology_gen";
+    string csvFile;
+    string jsonFile;
+};
+
+struct BenchRun
+{
+    string model;
+    int nodes;
+    long links;  // directed, as in the edge list's header
+    string dvrMode;
+    int threads;
+    int run;
+    double loadMs, dvrMs, lsrMs, wallMs;  // wallMs: the whole process, as seen from here
+};
+
+vector<string> splitList(const string &value)
+{
+    vector<string> items;
+    stringstream list(value);
+    string item;
+    while (getline(list, item, ','))
+        items.push_back(item);
+    return items;
+}
+
+vector<int> splitNumbers(const string &value)
+{
+    vector<string> items = splitList(value);
+    vector<int> numbers;
+    for (size_t i = 0; i < items.size(); ++i)
+        numbers.push_back(atoi(items[i].c_str()));
+    return numbers;
+}
+
+/**
+ * runProgram
+ * ----------
+ * Runs a program with its standard output sent to /dev/null and waits for it.
+ * Its standard error is passed through.
+ * returns         true if it exited with status 0
+ */
+bool runProgram(const vector<string> &args)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0)
+    {
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0)
+            _exit(127);
+        close(fd);
+        vector<char *> argv;
+        for (size_t a = 0; a < args.size(); ++a)
+            argv.push_back(const_cast<char *>(args[a].c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        perror(("Cannot run " + args[0]).c_str());
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        ;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The "name value" lines routing_sim --timing writes
+map<string, double> readTiming(const string &filename)
+{
+    map<string, double> values;
+    ifstream file(filename);
+    string name;
+    double value;
+    while (file >> name >> value)
+        values[name] = value;
+    return values;
+}
+
+// The node and link counts from the header of an edge list
+bool readHeader(const string &filename, int &nodes, long &links)
+{
+    ifstream file(filename);
+    return (bool)(file >> nodes >> links);
+}
+
+double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+void writeCSV(const string &filename, const vector<BenchRun> &runs)
+{
+    ofstream file(filename);
+    file << "model,nodes,links,dvr,threads,run,load_ms,dvr_ms,lsr_ms,wall_ms\n" << fixed << setprecision(3);
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        const BenchRun &b = runs[r];
+        file << b.model << "," << b.nodes << "," << b.links << "," << b.dvrMode << "," << b.threads << "," << b.run
+             << "," << b.loadMs << "," << b.dvrMs << "," << b.lsrMs << "," << b.wallMs << "\n";
+    }
+    if (!file)
+        cerr << "Error: Cannot write '" << filename << "'\n";
+}
+
+void writeJSON(const string &filename, const vector<BenchRun> &runs)
+{
+    ofstream file(filename);
+    file << "[\n" << fixed << setprecision(3);
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        const BenchRun &b = runs[r];
+        file << "  {\"model\": \"" << b.model << "\", \"nodes\": " << b.nodes << ", \"links\": " << b.links
+             << ", \"dvr\": \"" << b.dvrMode << "\", \"threads\": " << b.threads << ", \"run\": " << b.run
+             << ", \"load_ms\": " << b.loadMs << ", \"dvr_ms\": " << b.dvrMs << ", \"lsr_ms\": " << b.lsrMs
+             << ", \"wall_ms\": " << b.wallMs << "}" << (r + 1 < runs.size() ? ",\n" : "\n");
+    }
+    file << "]\n";
+    if (!file)
+        cerr << "Error: Cannot write '" << filename << "'\n";
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    bool valid = true;
+    for (int a = 1; valid && a < argc; a += 2)
+    {
+        string option = argv[a];
+        if (a + 1 >= argc)
+            valid = false;
+        else if (option == "--models")
+            options.models = splitList(argv[a + 1]);
+        else if (option == "--sizes")
+            options.sizes = splitNumbers(argv[a + 1]);
+        else if (option == "--threads")
+            options.threads = splitNumbers(argv[a + 1]);
+        else if (option == "--dvr")
+            options.dvrModes = splitList(argv[a + 1]);
+        else if (option == "--runs")
+            options.runs = atoi(argv[a + 1]);
+        else if (option == "--degree")
+            options.degree = atof(argv[a + 1]);
+        else if (option == "--seed")
+            options.seed = argv[a + 1];
+        else if (option == "--sim")
+            options.simulator = argv[a + 1];
+        else if (option == "--gen")
+            options.generator = argv[a + 1];
+        else if (option == "--csv")
+            options.csvFile = argv[a + 1];
+        else if (option == "--json")
+            options.jsonFile = argv[a + 1];
+        else
+            valid = false;
+    }
+    valid = valid && options.runs >= 1 && !options.models.empty() && !options.sizes.empty() &&
+            !options.threads.empty() && !options.dvrModes.empty();
+    for (size_t t = 0; t < options.threads.size(); ++t)
+        valid = valid && options.threads[t] >= 1;
+    if (!valid)
+    {
+        cerr << "Usage: " << argv[0] << " [--models er,waxman,ba,grid,fattree] [--sizes <n>,...] [--threads <t>,...]\n"
+             << "       [--dvr sweep|exchange[,...]] [--runs <r>] [--degree <d>] [--seed <s>]\n"
+             << "       [--sim <routing_sim>] [--gen <topology_gen>] [--csv <file>] [--json <file>]\n";
+        return EXIT_FAILURE;
+    }
+
+    char directory[] = "/tmp/routing_bench.XXXXXX";
+    if (!mkdtemp(directory))
+    {
+        perror("Cannot create a temporary directory");
+        return EXIT_FAILURE;
+    }
+    string topology = string(directory) + "/topology.txt";
+    string timing = string(directory) + "/timing.txt";
+
+    ostringstream degree;
+    degree << options.degree;
+    vector<BenchRun> results;
+    bool failed = false;
+    cout << left << setw(8) << "model" << right << setw(8) << "nodes" << setw(9) << "links" << setw(10) << "dvr"
+         << setw(8) << "threads" << setw(12) << "load ms" << setw(12) << "DVR ms" << setw(12) << "LSR ms"
+         << setw(10) << "speedup" << endl;
+    for (size_t m = 0; m < options.models.size() && !failed; ++m)
+    {
+        for (size_t s = 0; s < options.sizes.size() && !failed; ++s)
+        {
+            vector<string> generate = {options.generator, options.models[m], to_string(options.sizes[s]),
+                                       "--degree", degree.str(), "--seed", options.seed, "--output", topology};
+            int nodes;
+            long links;
+            if (!runProgram(generate) || !readHeader(topology, nodes, links))
+            {
+                cerr << "Error: Cannot generate " << options.models[m] << " topology of " << options.sizes[s]
+                     << " nodes\n";
+                failed = true;
+                break;
+            }
+            for (size_t d = 0; d < options.dvrModes.size() && !failed; ++d)
+            {
+                double baseline = 0;  // median DVR + LSR time at the first thread count
+                for (size_t t = 0; t < options.threads.size() && !failed; ++t)
+                {
+                    vector<double> load, dvr, lsr;
+                    for (int r = 0; r < options.runs; ++r)
+                    {
+                        vector<string> simulate = {options.simulator, topology, "--threads",
+                                                   to_string(options.threads[t]), "--dvr", options.dvrModes[d],
+                                                   "--timing", timing, "--quiet"};
+                        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                        bool ok = runProgram(simulate);
+                        double wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                        map<string, double> phases = readTiming(timing);
+                        if (!ok || phases.size() < 3)
+                        {
+                            cerr << "Error: " << options.simulator << " failed on " << options.models[m] << " with "
+                                 << nodes << " nodes\n";
+                            failed = true;
+                            break;
+                        }
+                        BenchRun run = {options.models[m], nodes, links, options.dvrModes[d], options.threads[t], r,
+                                        phases["load_ms"], phases["dvr_ms"], phases["lsr_ms"], wallMs};
+                        results.push_back(run);
+                        load.push_back(run.loadMs);
+                        dvr.push_back(run.dvrMs);
+                        lsr.push_back(run.lsrMs);
+                        unlink(timing.c_str());
+                    }
+                    if (failed)
+                        break;
+                    double total = median(dvr) + median(lsr);
+                    if (t == 0)
+                        baseline = total;
+                    cout << left << setw(8) << options.models[m] << right << setw(8) << nodes << setw(9) << links
+                         << setw(10) << options.dvrModes[d] << setw(8) << options.threads[t] << fixed
+                         << setprecision(1) << setw(12) << median(load) << setw(12) << median(dvr) << setw(12)
+                         << median(lsr) << setprecision(2) << setw(9) << (total > 0 ? baseline / total : 0) << "x\n"
+                         << flush;
+                }
+            }
+        }
+    }
+    unlink(topology.c_str());
+    unlink(timing.c_str());
+    rmdir(directory);
+
+    if (!options.csvFile.empty())
+        writeCSV(options.csvFile, results);
+    if (!options.jsonFile.empty())
+        writeJSON(options.jsonFile, results);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,47 +2,499 @@
 #include <vector>
 #include <limits>
 #include <queue>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <immintrin.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 using namespace std;
 
 // Define a large cost value to represent "infinite" distance (i.e., no direct link)
 const int INF = 9999;
 
-// This function prints the routing table for a single node in the Distance Vector Routing protocol.
-// It displays the destination, cost, and next hop for each possible destination.
-//
-// Parameters:
-// - node: The index of the node whose routing table is being printed.
-// - dist: A 2D matrix where dist[i][j] represents the cost from node i to node j.
-// - nextHop: A 2D matrix where nextHop[i][j] represents the next-hop node that node i should forward
-//            packets to in order to reach destination j optimally.
-void printDVRTable(int node,
-                   const vector<vector<int>> &dist,
-                   const vector<vector<int>> &nextHop)
-{
-    cout << "Node " << node << " Routing Table:\n";
-    cout << "Dest\tCost\tNext Hop\n";
-    int n = dist.size();
-    for (int dest = 0; dest < n; ++dest)
-    {
-        // Display destination
-        cout << dest << "\t";
-        // Display cost (INF if unreachable)
-        if (dist[node][dest] >= INF)
-            cout << "INF\t";
+// Routing table entries (dist and first hop) computed by LSR before they are printed
+const long LSR_TABLE_ENTRIES = 1L << 23;
+
+// Routing table entries rendered before they are written out
+const long TABLE_BATCH_ENTRIES = 1L << 19;
+
+// Rows of the DVR distance matrix relaxed together, sharing each row they read
+const int DVR_TILE_ROWS = 16;
+
+// Size of one (destination, cost) entry of a distance vector message, two 32-bit ints
+const int DVR_ENTRY_BYTES = 8;
+
+// Rounds after which a route that a neighbor stopped advertising (split horizon) expires,
+// RIP's 180 s timeout over its 30 s updates
+const int DVR_ROUTE_TIMEOUT = 6;
+
+/**
+ * CSRGraph
+ * --------
+ * The network in compressed sparse row form: the entries of node u are
+ * target[offset[u]] .. target[offset[u + 1] - 1], in increasing order of the
+ * target, with their costs in cost[]. Memory is O(n + m) instead of O(n^2),
+ * and Dijkstra only visits existing links.
+ *
+ * An entry is a cell of the adjacency matrix other than "no link": the links
+ * (cost < INF), the diagonal, and costs above INF, which are not links but are
+ * DVR's initial costs (they are stored as at most 2 * INF, which no sum of two
+ * costs below INF reaches). The arrays belong to storage, which is either
+ * memory filled by makeCSR() or a mapped binary file, so copies are cheap.
+ */
+struct CSRGraph
+{
+    int n;
+    const int *offset; // n + 1 entries
+    const int *target;
+    const int *cost;
+    shared_ptr<const void> storage;
+
+    int entries() const { return offset[n]; }
+};
+
+/**
+ * makeCSR
+ * -------
+ * A CSRGraph over the given arrays, which it takes over (the vectors are left empty).
+ */
+CSRGraph makeCSR(int n, vector<int> &offset, vector<int> &target, vector<int> &cost)
+{
+    struct Arrays
+    {
+        vector<int> offset, target, cost;
+    };
+    shared_ptr<Arrays> arrays = make_shared<Arrays>();
+    arrays->offset.swap(offset);
+    arrays->target.swap(target);
+    arrays->cost.swap(cost);
+    CSRGraph graph;
+    graph.n = n;
+    graph.offset = arrays->offset.data();
+    graph.target = arrays->target.data();
+    graph.cost = arrays->cost.data();
+    graph.storage = arrays;
+    return graph;
+}
+
+// RoutingMatrix
+// -------------
+// A matrix of ints in a single 32-byte aligned block, row after row.
+// Rows are padded to a multiple of 8 entries (one AVX2 register), so every
+// row starts aligned and the relaxation kernels need no tail loop. The
+// padding holds the fill value.
+class RoutingMatrix
+{
+public:
+    RoutingMatrix(int rows, int columns, int fillValue) : n(columns), stride((columns + 7) & ~7), data(nullptr)
+    {
+        if (posix_memalign((void **)&data, 32, (size_t)rows * stride * sizeof(int) + 32) != 0)
+        {
+            cerr << "Error: Out of memory for a " << rows << "x" << columns << " matrix\n";
+            exit(EXIT_FAILURE);
+        }
+        fill(data, data + (size_t)rows * stride, fillValue);
+    }
+    ~RoutingMatrix() { free(data); }
+
+    int *row(int i) { return data + (size_t)i * stride; }
+    const int *row(int i) const { return data + (size_t)i * stride; }
+    int columns() const { return n; }
+    int width() const { return stride; }
+
+private:
+    RoutingMatrix(const RoutingMatrix &);
+    RoutingMatrix &operator=(const RoutingMatrix &);
+
+    int n;
+    int stride;
+    int *data;
+};
+
+/**
+ * HopRow
+ * ------
+ * A read-only row of next hops, stored either as ints (RoutingMatrix) or as
+ * the 16-bit entries of a NextHopMatrix; -1 means no hop.
+ */
+struct HopRow
+{
+    const int *wide;
+    const uint16_t *narrow;
+
+    HopRow(const int *row = nullptr) : wide(row), narrow(nullptr) {}
+    explicit HopRow(const uint16_t *row) : wide(nullptr), narrow(row) {}
+    int operator[](int v) const { return wide ? wide[v] : narrow[v] == 0xFFFF ? -1 : narrow[v]; }
+};
+
+/**
+ * NextHopMatrix
+ * -------------
+ * The first hops of a set of sources to all n destinations, for LSR. The hop
+ * is all a table needs besides the cost, so it is kept in 16 bits per entry
+ * while node numbers fit (n < 65535), in 32 otherwise; either way all ones
+ * stands for no hop. Rows are set from dijkstra()'s firstHop[].
+ */
+class NextHopMatrix
+{
+public:
+    NextHopMatrix(int rows, int n) : n(n), wide(n >= 0xFFFF)
+    {
+        if (wide)
+            wideHops.resize((long)rows * n);
         else
-            cout << dist[node][dest] << "\t";
-        // Display next hop (- if no path)
-        if (nextHop[node][dest] == -1)
-            cout << "-";
+            narrowHops.resize((long)rows * n);
+    }
+
+    int get(int s, int v) const { return row(s)[v]; }
+
+    void set(int s, int v, int hop)
+    {
+        if (wide)
+            wideHops[(long)s * n + v] = hop;
         else
-            cout << nextHop[node][dest];
-        cout << "\n";
+            narrowHops[(long)s * n + v] = hop;
+    }
+
+    // Row s from an int row (-1: no hop)
+    void setRow(int s, const int *hops)
+    {
+        if (wide)
+            copy(hops, hops + n, &wideHops[(long)s * n]);
+        else
+            copy(hops, hops + n, &narrowHops[(long)s * n]); // -1 becomes 0xFFFF
+    }
+
+    HopRow row(int s) const { return wide ? HopRow(&wideHops[(long)s * n]) : HopRow(&narrowHops[(long)s * n]); }
+
+private:
+    int n;
+    bool wide;
+    vector<uint16_t> narrowHops;
+    vector<int> wideHops;
+};
+
+// Which protocol a routing table belongs to, in the CSV and binary table output
+enum Protocol
+{
+    PROTOCOL_DVR,
+    PROTOCOL_LSR
+};
+
+// The routing tables are printed through a TableWriter instead of cell by cell
+// with cout. A batch of tables is rendered into large preallocated buffers,
+// integers with appendInt() instead of the stream's formatting, split over
+// the threads by node, and the buffers go out in node order with one writev().
+//
+// Formats, by the name of the --tables file:
+// - text: the original tables, on standard output without --tables;
+// - CSV (*.csv): one "protocol,node,dest,cost,next_hop" row per entry, cost and
+//   next hop empty for unreachable destinations;
+// - binary (*.bin): the magic "RTBL" and a 32-bit version, then per table the
+//   32-bit protocol, node and entry count and one 32-bit (cost, next hop) pair
+//   per destination, -1 for INF and no hop.
+// With --quiet no tables are written at all.
+class TableWriter
+{
+public:
+    enum Format
+    {
+        FORMAT_TEXT,
+        FORMAT_CSV,
+        FORMAT_BINARY,
+        FORMAT_NONE
+    };
+
+    explicit TableWriter(int threads)
+        : format(FORMAT_TEXT), fd(STDOUT_FILENO), threads(max(1, threads)), buffers(this->threads) {}
+
+    ~TableWriter()
+    {
+        if (fd != STDOUT_FILENO)
+            close(fd);
+    }
+
+    // Writes the tables to filename instead, in the format of its extension
+    void open(const string &filename)
+    {
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            cerr << "Error: Cannot create tables file '" << filename << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        if (hasSuffix(filename, ".csv"))
+        {
+            format = FORMAT_CSV;
+            const char header[] = "protocol,node,dest,cost,next_hop\n";
+            writeAll(header, sizeof(header) - 1);
+        }
+        else if (hasSuffix(filename, ".bin"))
+        {
+            format = FORMAT_BINARY;
+            const char magic[8] = {'R', 'T', 'B', 'L', 1, 0, 0, 0}; // version 1, little-endian
+            writeAll(magic, sizeof(magic));
+        }
+    }
+
+    void quiet() { format = FORMAT_NONE; }
+
+    // Writes the tables of nodes first .. first + count - 1, each with n
+    // destinations. rows(node, cost, hop) points cost and hop at a node's table.
+    // The DVR text tables list every destination, the LSR ones all but the node itself.
+    void write(Protocol protocol, int first, int count, int n,
+               const function<void(int, const int *&, HopRow &)> &rows)
+    {
+        if (format == FORMAT_NONE || count <= 0)
+            return;
+        // Tables per batch, so the buffers stay around TABLE_BATCH_ENTRIES entries
+        int batch = max(1L, min((long)count, TABLE_BATCH_ENTRIES / max(n, 1)));
+        for (int start = first; start < first + count; start += batch)
+        {
+            int end = min(start + batch, first + count);
+            int parts = min(threads, end - start);
+            vector<thread> workers;
+            for (int t = 1; t < parts; ++t)
+                workers.push_back(thread(&TableWriter::render, this, protocol, part(start, end, parts, t),
+                                         part(start, end, parts, t + 1), n, cref(rows), t));
+            render(protocol, start, part(start, end, parts, 1), n, rows, 0);
+            for (size_t t = 0; t < workers.size(); ++t)
+                workers[t].join();
+            flushParts(parts);
+        }
+    }
+
+private:
+    // Longest rendering of one entry: a CSV row "lsr,<node>,<dest>,<cost>,<hop>\n"
+    static const int ENTRY_BYTES = 48;
+
+    struct Buffer
+    {
+        vector<char> data;
+        size_t used;
+    };
+
+    static bool hasSuffix(const string &s, const string &suffix)
+    {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    static int part(int start, int end, int parts, int k) { return start + (long)(end - start) * k / parts; }
+
+    // Writes v in decimal at p, returns the end
+    static char *appendInt(char *p, int v)
+    {
+        unsigned u = v;
+        if (v < 0)
+        {
+            *p++ = '-';
+            u = 0u - u;
+        }
+        char digits[10];
+        int k = 0;
+        do
+        {
+            digits[k++] = '0' + u % 10;
+            u /= 10;
+        } while (u);
+        while (k)
+            *p++ = digits[--k];
+        return p;
+    }
+
+    static char *appendText(char *p, const char *text, size_t length)
+    {
+        memcpy(p, text, length);
+        return p + length;
+    }
+
+    // Renders the tables of nodes first .. last - 1 into buffers[b]
+    void render(Protocol protocol, int first, int last, int n,
+                const function<void(int, const int *&, HopRow &)> &rows, int b)
+    {
+        Buffer &buffer = buffers[b];
+        size_t bound = (size_t)(last - first) * ((size_t)n * ENTRY_BYTES + 64);
+        if (buffer.data.size() < bound)
+            buffer.data.resize(bound);
+        char *p = buffer.data.data();
+        for (int node = first; node < last; ++node)
+        {
+            const int *cost;
+            HopRow hop;
+            rows(node, cost, hop);
+            if (format == FORMAT_BINARY)
+            {
+                int header[3] = {protocol, node, n};
+                p = appendText(p, (const char *)header, sizeof(header));
+                for (int dest = 0; dest < n; ++dest)
+                {
+                    int entry[2] = {cost[dest] >= INF ? -1 : cost[dest], hop[dest] < 0 ? -1 : hop[dest]};
+                    p = appendText(p, (const char *)entry, sizeof(entry));
+                }
+                continue;
+            }
+            const char *name = protocol == PROTOCOL_DVR ? "dvr," : "lsr,";
+            if (format == FORMAT_TEXT)
+            {
+                p = appendText(p, "Node ", 5);
+                p = appendInt(p, node);
+                const char title[] = " Routing Table:\nDest\tCost\tNext Hop\n";
+                p = appendText(p, title, sizeof(title) - 1);
+            }
+            char separator = format == FORMAT_CSV ? ',' : '\t';
+            for (int dest = 0; dest < n; ++dest)
+            {
+                if (protocol == PROTOCOL_LSR && dest == node)
+                    continue; // skip route to self
+                if (format == FORMAT_CSV)
+                {
+                    p = appendText(p, name, 4);
+                    p = appendInt(p, node);
+                    *p++ = ',';
+                }
+                p = appendInt(p, dest);
+                *p++ = separator;
+                if (cost[dest] < INF)
+                    p = appendInt(p, cost[dest]);
+                else if (format == FORMAT_TEXT)
+                    p = appendText(p, "INF", 3);
+                *p++ = separator;
+                if (hop[dest] >= 0)
+                    p = appendInt(p, hop[dest]);
+                else if (format == FORMAT_TEXT)
+                    *p++ = '-';
+                *p++ = '\n';
+            }
+            if (format == FORMAT_TEXT)
+                *p++ = '\n';
+        }
+        buffer.used = p - buffer.data.data();
+    }
+
+    // Writes the first parts buffers, in order, with as few system calls as possible
+    void flushParts(int parts)
+    {
+        vector<iovec> pieces(parts);
+        for (int b = 0; b < parts; ++b)
+        {
+            pieces[b].iov_base = buffers[b].data.data();
+            pieces[b].iov_len = buffers[b].used;
+        }
+        if (fd == STDOUT_FILENO)
+        {
+            // What cout printed so far comes first
+            cout.flush();
+            fflush(stdout);
+        }
+        size_t k = 0;
+        while (k < pieces.size())
+        {
+            ssize_t written = writev(fd, &pieces[k], min(pieces.size() - k, (size_t)IOV_MAX));
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                cerr << "Error: Cannot write the routing tables\n";
+                exit(EXIT_FAILURE);
+            }
+            for (; k < pieces.size() && (size_t)written >= pieces[k].iov_len; ++k)
+                written -= pieces[k].iov_len;
+            if (k < pieces.size())
+            {
+                pieces[k].iov_base = (char *)pieces[k].iov_base + written;
+                pieces[k].iov_len -= written;
+            }
+        }
+    }
+
+    void writeAll(const char *data, size_t size)
+    {
+        buffers[0].data.assign(data, data + size);
+        buffers[0].used = size;
+        flushParts(1);
+    }
+
+    Format format;
+    int fd;
+    int threads;
+    vector<Buffer> buffers; // one per thread
+};
+
+// relaxRow
+// --------
+// One step of the DVR relaxation: node i learns node j's distance vector.
+// For every destination k reachable from j, the route via j (cost d_ij +
+// dist[j][k], next hop hop_ij) replaces i's route if it is strictly shorter.
+// The destinations are independent, so they are done 8 at a time with AVX2
+// when the CPU has it. Returns true if a route changed.
+//
+// Parameters:
+// - dist_i, hop_i: Row i of the distance and next-hop matrices, updated.
+// - dist_j: Row j of the distance matrix (may be row i itself, which never changes it).
+// - width: Row length, a multiple of 8; padding entries are INF in dist_j.
+bool relaxRowScalar(int *dist_i, int *hop_i, const int *dist_j, int d_ij, int hop_ij, int width)
+{
+    bool updated = false;
+    for (int k = 0; k < width; ++k)
+    {
+        if (dist_j[k] < INF && dist_i[k] > d_ij + dist_j[k])
+        {
+            dist_i[k] = d_ij + dist_j[k];
+            hop_i[k] = hop_ij;
+            updated = true;
+        }
+    }
+    return updated;
+}
+
+__attribute__((target("avx2"))) bool relaxRowAVX2(int *dist_i, int *hop_i, const int *dist_j, int d_ij, int hop_ij, int width)
+{
+    const __m256i inf = _mm256_set1_epi32(INF);
+    const __m256i base = _mm256_set1_epi32(d_ij);
+    const __m256i hop = _mm256_set1_epi32(hop_ij);
+    __m256i changed = _mm256_setzero_si256();
+    for (int k = 0; k < width; k += 8)
+    {
+        __m256i via = _mm256_load_si256((const __m256i *)(dist_j + k));
+        __m256i current = _mm256_load_si256((const __m256i *)(dist_i + k));
+        __m256i candidate = _mm256_add_epi32(base, via);
+        // better = dist_j[k] < INF && dist_i[k] > candidate
+        __m256i better = _mm256_and_si256(_mm256_cmpgt_epi32(inf, via), _mm256_cmpgt_epi32(current, candidate));
+        if (_mm256_testz_si256(better, better))
+            continue;
+        _mm256_store_si256((__m256i *)(dist_i + k), _mm256_blendv_epi8(current, candidate, better));
+        __m256i hops = _mm256_load_si256((const __m256i *)(hop_i + k));
+        _mm256_store_si256((__m256i *)(hop_i + k), _mm256_blendv_epi8(hops, hop, better));
+        changed = _mm256_or_si256(changed, better);
     }
-    cout << endl;
+    return !_mm256_testz_si256(changed, changed);
+}
+
+typedef bool (*RelaxRowFn)(int *, int *, const int *, int, int, int);
+
+// The relaxation kernel for this CPU, chosen once.
+RelaxRowFn relaxRowImpl()
+{
+    static const RelaxRowFn impl = __builtin_cpu_supports("avx2") ? relaxRowAVX2 : relaxRowScalar;
+    return impl;
 }
 
 // simulateDVR
@@ -52,50 +504,72 @@ void printDVRTable(int node,
 // network. The algorithm iterates until all nodes have converged to their
 // optimal routing paths.
 //
+// Each sweep lets every node i learn every node j's vector, in the order i, j
+// of the original nested loops, so the tables (ties included) are unchanged.
+// The matrices are flat and aligned and each step is one relaxRow() call.
+// Within a sweep the rows before a tile of DVR_TILE_ROWS rows are final, so
+// the tile's rows learn them together: each such row j is read from memory
+// once per tile instead of once per row. The rows from the tile on are
+// learned row by row, as their order matters; a row of the tile that comes
+// after i is learned as it was before the tile started, from a copy.
+//
 // Parameters:
-// - graph: A 2D adjacency matrix representing the network. Each element
-//          graph[i][j] indicates the cost of the link between node i and
-//          node j, or INF if there is no direct link.
-void simulateDVR(const vector<vector<int>> &graph)
+// - graph: The network. Each entry (i, j) gives the cost of the link
+//          between node i and node j; there is no direct link without one.
+// - tables: Where the final tables are written.
+void simulateDVR(const CSRGraph &graph, TableWriter &tables)
 {
-    int n = graph.size();
+    int n = graph.n;
     // dist[i][j]: current best-known cost from node i to j
-    vector<vector<int>> dist = graph;
+    RoutingMatrix dist(n, n, INF);
     // nextHop[i][j]: the neighbor to which i forwards packets destined for j
-    vector<vector<int>> nextHop(n, vector<int>(n, -1));
+    RoutingMatrix nextHop(n, n, -1);
+    // The rows of the current tile as they were before it
+    RoutingMatrix tile(DVR_TILE_ROWS, n, INF);
 
     // Initialize direct neighbors: next hop for adjacent nodes is the node itself
     for (int i = 0; i < n; ++i)
     {
-        for (int j = 0; j < n; ++j)
+        for (int e = graph.offset[i]; e < graph.offset[i + 1]; ++e)
         {
-            if (i != j && graph[i][j] < INF)
-                nextHop[i][j] = j;
+            int j = graph.target[e];
+            dist.row(i)[j] = graph.cost[e];
+            if (i != j && graph.cost[e] < INF)
+                nextHop.row(i)[j] = j;
         }
     }
 
+    RelaxRowFn relaxRow = relaxRowImpl();
+    int width = dist.width();
     bool updated;
     // Repeat relaxation until no update occurs (i.e., convergence)
     do
     {
         updated = false;
-        // For each node i, try improving route to k via an intermediate node j
-        for (int i = 0; i < n; ++i)
+        for (int first = 0; first < n; first += DVR_TILE_ROWS)
         {
-            for (int j = 0; j < n; ++j)
+            int last = min(n, first + DVR_TILE_ROWS);
+            for (int i = first; i < last; ++i)
+                copy(dist.row(i), dist.row(i) + width, tile.row(i - first));
+            // Rows before the tile: each is read once for all of the tile's rows
+            for (int j = 0; j < first; ++j)
             {
-                if (dist[i][j] >= INF)
-                    continue; // skip unreachable intermediates
-                for (int k = 0; k < n; ++k)
+                for (int i = first; i < last; ++i)
                 {
-                    if (dist[j][k] < INF &&
-                        dist[i][k] > dist[i][j] + dist[j][k])
-                    {
-                        // Found a shorter path from i to k via j
-                        dist[i][k] = dist[i][j] + dist[j][k];
-                        nextHop[i][k] = nextHop[i][j];
-                        updated = true;
-                    }
+                    int d_ij = dist.row(i)[j];
+                    if (d_ij < INF) // skip unreachable intermediates
+                        updated |= relaxRow(dist.row(i), nextHop.row(i), dist.row(j), d_ij, nextHop.row(i)[j], width);
+                }
+            }
+            // The tile's own rows and the ones after it, in the original order
+            for (int i = first; i < last; ++i)
+            {
+                for (int j = first; j < n; ++j)
+                {
+                    int d_ij = dist.row(i)[j];
+                    const int *dist_j = j > i && j < last ? tile.row(j - first) : dist.row(j);
+                    if (j != i && d_ij < INF)
+                        updated |= relaxRow(dist.row(i), nextHop.row(i), dist_j, d_ij, nextHop.row(i)[j], width);
                 }
             }
         }
@@ -103,167 +577,2071 @@ void simulateDVR(const vector<vector<int>> &graph)
 
     // Print final routing tables for all nodes
     cout << "--- Distance Vector Routing Tables (Final) ---\n";
-    for (int i = 0; i < n; ++i)
-        printDVRTable(i, dist, nextHop);
+    tables.write(PROTOCOL_DVR, 0, n, n, [&](int i, const int *&cost, HopRow &hop)
+                 {
+                     cost = dist.row(i);
+                     hop = nextHop.row(i);
+                 });
 }
 
 /**
- * This function prints the routing table for a single node in the Link State Routing protocol.
- * It uses the predecessor array to determine the next-hop nodes on the shortest paths.
- * Parameters:
- *  src    The source node index whose routing table is being printed.
- *  dist   An array containing the shortest-path distances from the source node to all other nodes.
- *  prev   An array of predecessors where prev[v] = u indicates that node u precedes node v on the shortest path.
+ * DijkstraScratch
+ * ---------------
+ * Working memory of one thread's Dijkstra runs, kept from one source to the next
+ * so nothing is allocated per source.
  */
-void printLSRTable(int src,
-                   const vector<int> &dist,
-                   const vector<int> &prev)
-{
-    cout << "Node " << src << " Routing Table:\n";
-    cout << "Dest\tCost\tNext Hop\n";
-    int n = dist.size();
-    for (int dest = 0; dest < n; ++dest)
-    {
-        if (dest == src)
-            continue; // skip route to self
-
-        // Display cost
-        cout << dest << "\t";
-        if (dist[dest] >= INF)
-            cout << "INF\t";
-        else
-            cout << dist[dest] << "\t";
+struct DijkstraScratch
+{
+    vector<char> visited;
+    vector<pair<int, int>> heap; // (distance, node), a min-heap kept with push_heap/pop_heap
+};
+
+/**
+ * dijkstra
+ * --------
+ * Shortest paths from src with a binary heap, O(m log n). Nodes are settled
+ * in increasing (distance, index) order, the order in which the array scan of
+ * the original implementation picked them, so ties produce the same prev[].
+ * As before, nodes whose distance reaches INF are never settled.
+ *
+ * The first hop towards each node is carried along: a neighbor of src is its
+ * own first hop, any other node inherits its predecessor's, which is final
+ * since the predecessor is settled. The routing table then needs no walk back
+ * through prev[] per destination, which costs the path length each.
+ *
+ *  dist, prev, firstHop  --> n entries each, filled in (-1: no predecessor/hop)
+ */
+void dijkstra(const CSRGraph &graph, int src, int *dist, int *prev, int *firstHop, DijkstraScratch &scratch)
+{
+    fill(dist, dist + graph.n, INF);
+    fill(prev, prev + graph.n, -1);
+    fill(firstHop, firstHop + graph.n, -1);
+    vector<char> &visited = scratch.visited;
+    visited.assign(graph.n, 0);
+    // Outdated heap entries are skipped when popped
+    vector<pair<int, int>> &heap = scratch.heap;
+    heap.clear();
+    greater<pair<int, int>> later;
 
-        // Trace back from destination to find first hop
-        int hop = dest;
-        while (prev[hop] != -1 && prev[hop] != src)
+    dist[src] = 0;
+    heap.push_back(make_pair(0, src));
+    while (!heap.empty())
+    {
+        pop_heap(heap.begin(), heap.end(), later);
+        int d = heap.back().first;
+        int u = heap.back().second;
+        heap.pop_back();
+        if (d >= INF)
+            break; // no reachable unvisited nodes remain
+        if (visited[u] || d != dist[u])
+            continue;
+
+        visited[u] = true;
+        // Relax the links of u
+        for (int e = graph.offset[u]; e < graph.offset[u + 1]; ++e)
         {
-            hop = prev[hop];
+            int v = graph.target[e];
+            if (dist[v] > d + graph.cost[e])
+            {
+                dist[v] = d + graph.cost[e];
+                prev[v] = u;
+                firstHop[v] = u == src ? v : firstHop[u];
+                heap.push_back(make_pair(dist[v], v));
+                push_heap(heap.begin(), heap.end(), later);
+            }
         }
-        // If no path exists, indicate unreachable
-        if (prev[hop] == -1)
-            cout << "-";
-        else
-            cout << hop;
-
-        cout << "\n";
     }
-    cout << endl;
 }
 
 /**
- * simulateLSR
- * -----------
- * Implements the Link State Routing protocol using Dijkstra's algorithm.
- * For each node, it computes shortest paths to all other nodes in the network.
- *
- * Parameters: graph  Adjacency matrix of the network: graph[i][j] is cost of link i-j,
- *               or INF if no direct link exists.
+ * WorkStealingPool
+ * ----------------
+ * A fixed set of threads that run batches of independent tasks. Each worker
+ * owns a deque of task indices, initially a contiguous share of the batch; it
+ * takes tasks from the front of its own deque and, once that is empty, steals
+ * from the back of the others'. Workers that drew cheap tasks (sources in small
+ * components) thus help the others instead of going idle.
  */
-void simulateLSR(const vector<vector<int>> &graph)
+class WorkStealingPool
 {
-    int n = graph.size();
+public:
+    explicit WorkStealingPool(int threads) : queues(threads)
+    {
+        for (int w = 0; w < threads; ++w)
+            workers.push_back(thread(&WorkStealingPool::work, this, w));
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        start.notify_all();
+        for (size_t w = 0; w < workers.size(); ++w)
+            workers[w].join();
+    }
+
+    int size() const { return workers.size(); }
 
-    // Run Dijkstra's algorithm from each node as source
-    for (int src = 0; src < n; ++src)
+    // Runs task(worker, index) for every index in [0, count) and waits for all of them.
+    void run(int count, const function<void(int, int)> &task)
     {
-        vector<int> dist(n, INF); // shortest known distance from src
-        vector<int> prev(n, -1);  // predecessor on shortest path
-        vector<bool> visited(n, false);
+        int threads = workers.size();
+        for (int w = 0; w < threads; ++w)
+        {
+            lock_guard<mutex> lock(queues[w].m);
+            for (int i = (long)count * w / threads; i < (long)count * (w + 1) / threads; ++i)
+                queues[w].tasks.push_back(i);
+        }
+        unique_lock<mutex> lock(m);
+        current = &task;
+        running = threads;
+        ++generation;
+        start.notify_all();
+        done.wait(lock, [this] { return running == 0; });
+    }
 
-        dist[src] = 0; // distance to self is zero
+private:
+    struct WorkerQueue
+    {
+        mutex m;
+        deque<int> tasks;
+    };
 
-        for (int iter = 0; iter < n; ++iter)
+    bool take(int w, int &index)
+    {
+        for (size_t k = 0; k < queues.size(); ++k)
         {
-            // Select the unvisited node with smallest distance
-            int u = -1;
-            for (int i = 0; i < n; ++i)
+            WorkerQueue &queue = queues[(w + k) % queues.size()];
+            lock_guard<mutex> lock(queue.m);
+            if (queue.tasks.empty())
+                continue;
+            if (k == 0)
             {
-                if (!visited[i] && (u == -1 || dist[i] < dist[u]))
-                    u = i;
+                index = queue.tasks.front(); // own work, in order
+                queue.tasks.pop_front();
             }
-            if (u == -1 || dist[u] >= INF)
-                break; // no reachable unvisited nodes remain
-
-            visited[u] = true;
-            // Relax edges outgoing from u
-            for (int v = 0; v < n; ++v)
+            else
             {
-                if (graph[u][v] < INF && dist[v] > dist[u] + graph[u][v])
-                {
-                    dist[v] = dist[u] + graph[u][v];
-                    prev[v] = u;
-                }
+                index = queue.tasks.back(); // stolen, from the far end
+                queue.tasks.pop_back();
             }
+            return true;
         }
+        return false;
+    }
 
-        // Print the routing table for this source node
-        printLSRTable(src, dist, prev);
+    void work(int w)
+    {
+        long seen = 0;
+        while (true)
+        {
+            const function<void(int, int)> *task;
+            {
+                unique_lock<mutex> lock(m);
+                start.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                task = current;
+            }
+            int index;
+            while (take(w, index))
+                (*task)(w, index);
+            lock_guard<mutex> lock(m);
+            if (--running == 0)
+                done.notify_one();
+        }
     }
-}
+
+    vector<WorkerQueue> queues;
+    vector<thread> workers;
+    mutex m;
+    condition_variable start, done;
+    const function<void(int, int)> *current = nullptr;
+    long generation = 0;
+    int running = 0;
+    bool stopping = false;
+};
 
 /**
- * readGraphFromFile
- * -----------------
- * Reads a network topology from a text file. The first line contains an integer n,
- * the number of nodes. The following n lines each contain n space-separated integers,
- * representing the adjacency matrix of link costs.
+ * simulateLSR
+ * -----------
+ * Implements the Link State Routing protocol using Dijkstra's algorithm.
+ * For each node, it computes shortest paths to all other nodes in the network.
+ * The graph is in CSR form, so all pairs take O(n m log n) instead of O(n^3).
  *
- *  filename  --> Path to the input file
- * returns         Adjacency matrix of size n x n
+ * The sources are independent, so their Dijkstra runs are spread over a
+ * work-stealing pool. Sources are processed in blocks: the tables of a block
+ * (at most LSR_TABLE_ENTRIES entries) are computed in parallel into
+ * preallocated rows, then printed in node order. Only the costs and the
+ * first hops are kept (see NextHopMatrix); prev[] is per worker.
+ *
+ * Parameters: graph    The network.
+ *             threads  Number of worker threads.
+ *             tables   Where the tables are written.
  */
-vector<vector<int>> readGraphFromFile(const string &filename)
+void simulateLSR(const CSRGraph &graph, int threads, TableWriter &tables)
 {
-    ifstream file(filename);
-    if (!file.is_open())
+    int n = graph.n;
+    if (n == 0)
+        return;
+    WorkStealingPool pool(threads);
+    vector<DijkstraScratch> scratch(pool.size());
+    vector<vector<int>> prev(pool.size(), vector<int>(n));
+    vector<vector<int>> firstHop(pool.size(), vector<int>(n));
+
+    // Enough sources per block to keep every worker busy, as many as fit the budget
+    int block = max((long)pool.size() * 4, LSR_TABLE_ENTRIES / n);
+    block = min(block, n);
+    vector<int> dist((long)block * n); // row i: shortest known distances from source first + i
+    NextHopMatrix hops(block, n);      // row i: first hops
+
+    for (int first = 0; first < n; first += block)
     {
-        cerr << "Error: Cannot open input file '" << filename << "'\n";
-        exit(EXIT_FAILURE);
+        int count = min(block, n - first);
+        pool.run(count, [&](int worker, int i)
+                 {
+                     dijkstra(graph, first + i, &dist[(long)i * n], prev[worker].data(), firstHop[worker].data(),
+                              scratch[worker]);
+                     hops.setRow(i, firstHop[worker].data());
+                 });
+
+        // Print the routing tables of the block in node order
+        tables.write(PROTOCOL_LSR, first, count, n, [&](int src, const int *&cost, HopRow &hop)
+                     {
+                         cost = &dist[(long)(src - first) * n];
+                         hop = hops.row(src - first);
+                     });
     }
+}
 
-    int n;
-    file >> n;
-    vector<vector<int>> graph(n, vector<int>(n, INF));
+// DVRMetrics
+// ----------
+// The cost of a message-passing DVR run. A message is one (possibly partial)
+// distance vector sent over one link; each entry in it is a destination and a
+// cost, DVR_ENTRY_BYTES on the wire.
+struct DVRMetrics
+{
+    int rounds;
+    long long messages;
+    long long entries;
+
+    DVRMetrics() : rounds(0), messages(0), entries(0) {}
+    long long bytes() const { return entries * DVR_ENTRY_BYTES; }
+};
 
+// exchangeDistanceVectors
+// -----------------------
+// Runs distance vector routing as the nodes themselves would: node i only
+// knows its own vector dist[i] and the costs of its own links, and learns
+// about the rest of the network from the vectors its neighbors send it.
+// Time advances in synchronous rounds. In the first round every node sends
+// its whole initial vector; afterwards a node sends only the entries that
+// changed in the previous round (a triggered, incremental update), and only
+// nodes that received something recompute anything. The exchange has
+// converged when a round leaves no vector changed.
+//
+// Node j's vector is sent to every node i with a link i -> j, which is the
+// link i would use to route via j. A receiver reads its neighbors' messages
+// in increasing neighbor order and only replaces a route by a strictly
+// shorter one, so the result doesn't depend on the number of threads.
+//
+// Parameters:
+// - graph: The links of the network.
+// - dist, nextHop: n x n matrices (INF / -1), filled in with the final tables.
+// - pool: Receivers are processed on its threads, each node writes only its row.
+// - metrics: Filled in with the rounds, messages and entries exchanged.
+void exchangeDistanceVectors(const CSRGraph &graph,
+                             RoutingMatrix &dist,
+                             RoutingMatrix &nextHop,
+                             WorkStealingPool &pool,
+                             DVRMetrics &metrics)
+{
+    int n = graph.n;
+    // pending[i]: destinations whose entry in i's vector changed since i last sent it
+    vector<vector<int>> pending(n);
+    vector<char> isPending((size_t)n * n, 0);
+    // Initial vectors: the node itself and its direct neighbors
     for (int i = 0; i < n; ++i)
     {
+        dist.row(i)[i] = 0;
+        pending[i].push_back(i);
+        isPending[(size_t)i * n + i] = 1;
+        for (int e = graph.offset[i]; e < graph.offset[i + 1]; ++e)
+        {
+            int j = graph.target[e];
+            if (j == i || graph.cost[e] >= dist.row(i)[j])
+                continue;
+            dist.row(i)[j] = graph.cost[e];
+            nextHop.row(i)[j] = j;
+            if (!isPending[(size_t)i * n + j])
+            {
+                isPending[(size_t)i * n + j] = 1;
+                pending[i].push_back(j);
+            }
+        }
+    }
+
+    // Messages of the current round: node j's is (outDest, outCost)[outOffset[j] .. outOffset[j + 1])
+    vector<long> outOffset(n + 1);
+    vector<int> outDest, outCost;
+    vector<DVRMetrics> workerMetrics(pool.size());
+    while (true)
+    {
+        // Every node sends the entries that changed, as they are at the start of the round
+        outDest.clear();
+        outCost.clear();
         for (int j = 0; j < n; ++j)
         {
-            int cost;
-            file >> cost;
-            if (cost >= 0)
-                graph[i][j] = cost;
-            // Negative or missing cost interpreted as INF
+            outOffset[j] = outDest.size();
+            for (size_t p = 0; p < pending[j].size(); ++p)
+            {
+                int k = pending[j][p];
+                outDest.push_back(k);
+                outCost.push_back(dist.row(j)[k]);
+                isPending[(size_t)j * n + k] = 0;
+            }
+            pending[j].clear();
         }
+        outOffset[n] = outDest.size();
+        if (outDest.empty())
+            break; // nothing changed in the last round: converged
+        ++metrics.rounds;
+
+        pool.run(n, [&](int worker, int i)
+                 {
+            int *dist_i = dist.row(i);
+            int *hop_i = nextHop.row(i);
+            DVRMetrics &counts = workerMetrics[worker];
+            for (int e = graph.offset[i]; e < graph.offset[i + 1]; ++e)
+            {
+                int j = graph.target[e];
+                int d_ij = graph.cost[e];
+                if (j == i || d_ij >= INF || outOffset[j] == outOffset[j + 1])
+                    continue; // not a link, or j sent nothing this round
+                ++counts.messages;
+                counts.entries += outOffset[j + 1] - outOffset[j];
+                for (long p = outOffset[j]; p < outOffset[j + 1]; ++p)
+                {
+                    int k = outDest[p];
+                    if (d_ij + outCost[p] < dist_i[k])
+                    {
+                        dist_i[k] = d_ij + outCost[p];
+                        hop_i[k] = j;
+                        if (!isPending[(size_t)i * n + k])
+                        {
+                            isPending[(size_t)i * n + k] = 1;
+                            pending[i].push_back(k);
+                        }
+                    }
+                }
+            } });
     }
-    file.close();
-    return graph;
+    for (size_t w = 0; w < workerMetrics.size(); ++w)
+    {
+        metrics.messages += workerMetrics[w].messages;
+        metrics.entries += workerMetrics[w].entries;
+    }
+}
+
+// simulateDVRExchange
+// -------------------
+// Simulates the Distance Vector Routing protocol by message passing (see
+// exchangeDistanceVectors) and prints the final tables, followed by what it
+// took to converge. The costs are the shortest path costs, as with
+// simulateDVR; next hops can differ where several paths tie.
+//
+// Parameters:
+// - graph: The network.
+// - threads: Number of worker threads.
+// - tables: Where the final tables are written.
+void simulateDVRExchange(const CSRGraph &graph, int threads, TableWriter &tables)
+{
+    int n = graph.n;
+    RoutingMatrix dist(n, n, INF);
+    RoutingMatrix nextHop(n, n, -1);
+    WorkStealingPool pool(threads);
+    DVRMetrics metrics;
+    exchangeDistanceVectors(graph, dist, nextHop, pool, metrics);
+
+    cout << "--- Distance Vector Routing Tables (Final) ---\n";
+    tables.write(PROTOCOL_DVR, 0, n, n, [&](int i, const int *&cost, HopRow &hop)
+                 {
+                     cost = dist.row(i);
+                     hop = nextHop.row(i);
+                 });
+    cout << "Converged after " << metrics.rounds << " rounds: " << metrics.messages << " messages, "
+         << metrics.entries << " entries, " << metrics.bytes() << " bytes\n";
 }
 
 /**
- * main
- * ----
- * Entry point of the simulation program.
- * Expects a single command-line argument: path to the topology file.
- * Calls both DVR and LSR simulation routines and prints their routing tables.
+ * LinkEvent
+ * ---------
+ * A change to the bidirectional link u-v: its new cost, or INF when it goes down.
  */
-int main(int argc, char *argv[])
+struct LinkEvent
 {
-    if (argc != 2)
-    {
-        cerr << "Usage: " << argv[0] << " <topology_file>\n";
-        return EXIT_FAILURE;
-    }
+    string kind; // "up", "down" or "cost", as written in the events file
+    int u, v;
+    int cost;
+};
 
-    string filename = argv[1];
-    // Load network topology from file
-    vector<vector<int>> graph = readGraphFromFile(filename);
+/**
+ * RouteChange
+ * -----------
+ * An entry of node src's LSR table that an event changed, with its new cost
+ * (INF if unreachable) and next hop (-1 if none).
+ */
+struct RouteChange
+{
+    int src, dest;
+    int cost, hop;
+};
 
-    cout << "\n--- Distance Vector Routing Simulation ---\n";
-    simulateDVR(graph);
+/**
+ * EventReport
+ * -----------
+ * What applying one event changed and cost. scanned counts the links the
+ * incremental update looked at; fullScan is how many a full recompute (one
+ * Dijkstra per source, which scans the links of every reachable node) would.
+ */
+struct EventReport
+{
+    vector<RouteChange> changes;
+    int tables;
+    long long scanned;
+    long long fullScan;
+    double ms;
+};
+
+/**
+ * DynamicRoutes
+ * -------------
+ * The LSR tables (dist[], prev[] and first hops) of every source, kept up to
+ * date as links come up, go down or change cost, without recomputing them.
+ *
+ * After a change of link a -> b only the sources whose shortest path tree
+ * depends on it do any work, and only on the nodes involved
+ * (Ramalingam-Reps):
+ *  - cost decrease: if the link now gives b a shorter path, Dijkstra runs
+ *    from b, through the nodes it actually improves;
+ *  - cost increase or link down: if the link was on a shortest path to b,
+ *    the nodes that have no other shortest path (found in increasing
+ *    distance order, as each one's in-links are checked) get their distance
+ *    from their other in-links and Dijkstra runs among them.
+ * The predecessors of the nodes whose distance changed and of their
+ * out-neighbors are then reselected with dijkstra()'s rule: the tight
+ * in-neighbor with the smallest (distance, index), which is the one it
+ * settles first when all costs are positive. The tables are therefore the
+ * same as a full recompute on the new topology. With zero-cost links the
+ * settling order is not determined by (distance, index), so the affected
+ * sources are recomputed with dijkstra() instead.
+ */
+class DynamicRoutes
+{
+public:
+    DynamicRoutes(const CSRGraph &graph, WorkStealingPool &pool)
+        : n(graph.n), pool(pool), out(n), in(n), distances((long)n * n), prevs((long)n * n), hops(n, n),
+          touched(n), scratch(pool.size()), zeroLinks(0), fullScan(0)
+    {
+        for (int u = 0; u < n; ++u)
+        {
+            for (int e = graph.offset[u]; e < graph.offset[u + 1]; ++e)
+            {
+                int v = graph.target[e];
+                if (graph.cost[e] < INF)
+                {
+                    out[u].push_back(Link(v, graph.cost[e]));
+                    in[v].push_back(Link(u, graph.cost[e]));
+                    zeroLinks += u != v && graph.cost[e] == 0;
+                }
+            }
+        }
+        for (size_t w = 0; w < scratch.size(); ++w)
+            scratch[w].resize(n);
+
+        vector<DijkstraScratch> dijkstraScratch(pool.size());
+        pool.run(n, [&](int worker, int s)
+                 {
+            dijkstra(graph, s, distRow(s), prevRow(s), scratch[worker].firstHop.data(), dijkstraScratch[worker]);
+            hops.setRow(s, scratch[worker].firstHop.data()); });
+        for (int s = 0; s < n; ++s)
+            for (int v = 0; v < n; ++v)
+                if (dist(s)[v] < INF)
+                    fullScan += out[v].size();
+    }
+
+    int size() const { return n; }
+    const int *dist(int s) const { return &distances[(long)s * n]; }
+    const int *prev(int s) const { return &prevs[(long)s * n]; }
+    HopRow hop(int s) const { return hops.row(s); }
+
+    // Applies the event to both directions of the link and reports the table entries it changed.
+    EventReport apply(const LinkEvent &event)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        EventReport report;
+        report.tables = 0;
+        report.scanned = 0;
+        setLink(event.u, event.v, event.cost, report);
+        setLink(event.v, event.u, event.cost, report);
+
+        // Entries touched more than once keep the value from before the event
+        for (int s = 0; s < n; ++s)
+        {
+            vector<TouchedEntry> &entries = touched[s];
+            stable_sort(entries.begin(), entries.end(),
+                        [](const TouchedEntry &x, const TouchedEntry &y)
+                        { return x.dest < y.dest; });
+            bool changed = false;
+            for (size_t e = 0; e < entries.size(); ++e)
+            {
+                int v = entries[e].dest;
+                if ((e > 0 && entries[e - 1].dest == v) || v == s)
+                    continue;
+                int cost = min(dist(s)[v], INF);
+                if (cost != entries[e].cost || hops.get(s, v) != entries[e].hop)
+                {
+                    RouteChange change = {s, v, cost, hops.get(s, v)};
+                    report.changes.push_back(change);
+                    changed = true;
+                }
+            }
+            report.tables += changed;
+            entries.clear();
+        }
+        report.fullScan = fullScan;
+        report.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+private:
+    struct Link
+    {
+        int node, cost;
+        Link(int node, int cost) : node(node), cost(cost) {}
+    };
+
+    struct TouchedEntry
+    {
+        int dest, cost, hop; // the entry before it was modified
+    };
+
+    // Per-worker working memory; a node is in a set when its mark equals stamp
+    struct Scratch
+    {
+        vector<int> affected, queued, reselected, rehopped;
+        int stamp;
+        vector<pair<int, int>> heap;
+        vector<int> changedNodes, affectedNodes, reselect, rehop;
+        vector<int> firstHop; // dijkstra()'s, before it goes into hops
+        long long scanned;
+        long long fullScanDelta;
+
+        void resize(int n)
+        {
+            affected.assign(n, 0);
+            queued.assign(n, 0);
+            reselected.assign(n, 0);
+            rehopped.assign(n, 0);
+            firstHop.assign(n, -1);
+            stamp = 0;
+        }
+    };
+
+    int *distRow(int s) { return &distances[(long)s * n]; }
+    int *prevRow(int s) { return &prevs[(long)s * n]; }
+
+    void touch(int s, int v)
+    {
+        TouchedEntry entry = {v, min(distRow(s)[v], INF), hops.get(s, v)};
+        touched[s].push_back(entry);
+    }
+
+    // Sets the cost of link a -> b (INF: no link) and updates every source's tables.
+    void setLink(int a, int b, int cost, EventReport &report)
+    {
+        int oldCost = INF;
+        for (size_t e = 0; e < out[a].size(); ++e)
+            if (out[a][e].node == b)
+                oldCost = out[a][e].cost;
+        if (cost == oldCost)
+            return;
+        replaceLink(out[a], b, cost);
+        replaceLink(in[b], a, cost);
+        zeroLinks += (cost == 0) - (oldCost == 0);
+
+        // a's out-degree changed for every source that reaches a
+        if ((oldCost >= INF) != (cost >= INF))
+        {
+            long reaching = 0;
+            for (int s = 0; s < n; ++s)
+                reaching += distRow(s)[a] < INF;
+            fullScan += cost < INF ? reaching : -reaching;
+        }
+
+        // Zero-cost links before or after the change: recompute (see the class comment)
+        bool recompute = zeroLinks > 0 || oldCost == 0;
+        CSRGraph csr;
+        vector<DijkstraScratch> dijkstraScratch;
+        if (recompute)
+        {
+            csr = currentCSR();
+            dijkstraScratch.resize(pool.size());
+        }
+        for (size_t w = 0; w < scratch.size(); ++w)
+            scratch[w].scanned = scratch[w].fullScanDelta = 0;
+        pool.run(n, [&](int worker, int s)
+                 {
+            if (recompute)
+                recomputeSource(s, csr, dijkstraScratch[worker], scratch[worker]);
+            else
+                updateSource(s, a, b, oldCost, cost, scratch[worker]); });
+        for (size_t w = 0; w < scratch.size(); ++w)
+        {
+            report.scanned += scratch[w].scanned;
+            fullScan += scratch[w].fullScanDelta;
+        }
+    }
+
+    // Keeps the list sorted by node, as CSRGraph orders the links.
+    static void replaceLink(vector<Link> &links, int node, int cost)
+    {
+        vector<Link>::iterator it = links.begin();
+        while (it != links.end() && it->node < node)
+            ++it;
+        if (it != links.end() && it->node == node)
+        {
+            if (cost < INF)
+                it->cost = cost;
+            else
+                links.erase(it);
+        }
+        else if (cost < INF)
+            links.insert(it, Link(node, cost));
+    }
+
+    CSRGraph currentCSR() const
+    {
+        vector<int> offset(1, 0), target, cost;
+        for (int u = 0; u < n; ++u)
+        {
+            for (size_t e = 0; e < out[u].size(); ++e)
+            {
+                target.push_back(out[u][e].node);
+                cost.push_back(out[u][e].cost);
+            }
+            offset.push_back(target.size());
+        }
+        return makeCSR(n, offset, target, cost);
+    }
+
+    // Source s's tables after link a -> b went from oldCost to newCost (both possibly INF).
+    void updateSource(int s, int a, int b, int oldCost, int newCost, Scratch &sc)
+    {
+        int *d = distRow(s);
+        if (d[a] >= INF || b == s)
+            return; // s doesn't reach a, or b is s itself: no path of s uses the link
+        ++sc.stamp;
+        sc.changedNodes.clear();
+        greater<pair<int, int>> later;
+
+        if (newCost < oldCost)
+        {
+            // Decrease: improve b and whatever it now reaches faster
+            int via = d[a] + newCost;
+            if (via < min(d[b], INF))
+            {
+                sc.heap.clear();
+                improve(s, b, via, sc);
+                while (!sc.heap.empty())
+                {
+                    pop_heap(sc.heap.begin(), sc.heap.end(), later);
+                    int du = sc.heap.back().first;
+                    int u = sc.heap.back().second;
+                    sc.heap.pop_back();
+                    if (du != d[u])
+                        continue;
+                    sc.scanned += out[u].size();
+                    for (size_t e = 0; e < out[u].size(); ++e)
+                    {
+                        int v = out[u][e].node;
+                        int dv = du + out[u][e].cost;
+                        if (v != u && dv < min(d[v], INF))
+                            improve(s, v, dv, sc);
+                    }
+                }
+            }
+        }
+        else if (d[b] < INF && d[a] + oldCost == d[b])
+        {
+            // Increase on a shortest path: find the nodes left without one, in distance order
+            sc.affectedNodes.clear();
+            sc.heap.clear();
+            sc.heap.push_back(make_pair(d[b], b));
+            sc.queued[b] = sc.stamp;
+            while (!sc.heap.empty())
+            {
+                pop_heap(sc.heap.begin(), sc.heap.end(), later);
+                int v = sc.heap.back().second;
+                sc.heap.pop_back();
+                bool supported = false;
+                sc.scanned += in[v].size();
+                for (size_t e = 0; e < in[v].size() && !supported; ++e)
+                {
+                    int u = in[v][e].node;
+                    supported = u != v && sc.affected[u] != sc.stamp && d[u] < INF && d[u] + in[v][e].cost == d[v];
+                }
+                if (supported)
+                    continue;
+                sc.affected[v] = sc.stamp;
+                sc.affectedNodes.push_back(v);
+                sc.scanned += out[v].size();
+                for (size_t e = 0; e < out[v].size(); ++e)
+                {
+                    int w = out[v][e].node;
+                    if (w != v && sc.queued[w] != sc.stamp && d[w] < INF && d[v] + out[v][e].cost == d[w])
+                    {
+                        sc.queued[w] = sc.stamp;
+                        sc.heap.push_back(make_pair(d[w], w));
+                        push_heap(sc.heap.begin(), sc.heap.end(), later);
+                    }
+                }
+            }
+
+            // Their best path through the rest of the tree, then Dijkstra among them
+            sc.heap.clear();
+            for (size_t i = 0; i < sc.affectedNodes.size(); ++i)
+            {
+                int v = sc.affectedNodes[i];
+                touch(s, v);
+                sc.changedNodes.push_back(v);
+                int best = INF;
+                sc.scanned += in[v].size();
+                for (size_t e = 0; e < in[v].size(); ++e)
+                {
+                    int u = in[v][e].node;
+                    if (u != v && sc.affected[u] != sc.stamp && d[u] < INF)
+                        best = min(best, d[u] + in[v][e].cost);
+                }
+                d[v] = best;
+                if (best < INF)
+                {
+                    sc.heap.push_back(make_pair(best, v));
+                    push_heap(sc.heap.begin(), sc.heap.end(), later);
+                }
+            }
+            while (!sc.heap.empty())
+            {
+                pop_heap(sc.heap.begin(), sc.heap.end(), later);
+                int du = sc.heap.back().first;
+                int u = sc.heap.back().second;
+                sc.heap.pop_back();
+                if (du != d[u])
+                    continue;
+                sc.scanned += out[u].size();
+                for (size_t e = 0; e < out[u].size(); ++e)
+                {
+                    int v = out[u][e].node;
+                    int dv = du + out[u][e].cost;
+                    if (v != u && sc.affected[v] == sc.stamp && dv < d[v])
+                    {
+                        d[v] = dv;
+                        sc.heap.push_back(make_pair(dv, v));
+                        push_heap(sc.heap.begin(), sc.heap.end(), later);
+                    }
+                }
+            }
+            for (size_t i = 0; i < sc.affectedNodes.size(); ++i)
+            {
+                int v = sc.affectedNodes[i];
+                if (d[v] >= INF)
+                {
+                    d[v] = INF;
+                    sc.fullScanDelta -= out[v].size();
+                }
+            }
+        }
+
+        // Reselect the predecessors that may have changed: b's and those of the changed
+        // nodes and their out-neighbors
+        sc.reselect.clear();
+        markForReselect(b, sc);
+        for (size_t i = 0; i < sc.changedNodes.size(); ++i)
+        {
+            int u = sc.changedNodes[i];
+            markForReselect(u, sc);
+            sc.scanned += out[u].size();
+            for (size_t e = 0; e < out[u].size(); ++e)
+                markForReselect(out[u][e].node, sc);
+        }
+        int *p = prevRow(s);
+        sc.rehop.clear();
+        for (size_t i = 0; i < sc.reselect.size(); ++i)
+        {
+            int v = sc.reselect[i];
+            if (v == s)
+                continue;
+            int best = -1;
+            if (d[v] < INF)
+            {
+                sc.scanned += in[v].size();
+                for (size_t e = 0; e < in[v].size(); ++e)
+                {
+                    int u = in[v][e].node;
+                    if (u != v && d[u] < INF && d[u] + in[v][e].cost == d[v] &&
+                        (best == -1 || d[u] < d[best] || (d[u] == d[best] && u < best)))
+                        best = u;
+                }
+            }
+            if (best != p[v])
+            {
+                touch(s, v);
+                p[v] = best;
+                sc.rehopped[v] = sc.stamp;
+                sc.rehop.push_back(v);
+            }
+        }
+
+        // First hops of the nodes whose predecessor changed and of their subtrees,
+        // parents first (with positive costs a parent is closer to s than its children)
+        for (size_t i = 0; i < sc.rehop.size(); ++i)
+        {
+            int u = sc.rehop[i];
+            sc.scanned += out[u].size();
+            for (size_t e = 0; e < out[u].size(); ++e)
+            {
+                int v = out[u][e].node;
+                if (p[v] == u && v != u && sc.rehopped[v] != sc.stamp)
+                {
+                    sc.rehopped[v] = sc.stamp;
+                    sc.rehop.push_back(v);
+                }
+            }
+        }
+        sort(sc.rehop.begin(), sc.rehop.end(), [d](int x, int y)
+             { return d[x] < d[y] || (d[x] == d[y] && x < y); });
+        for (size_t i = 0; i < sc.rehop.size(); ++i)
+        {
+            int v = sc.rehop[i];
+            int hv = p[v] == -1 ? -1 : p[v] == s ? v : hops.get(s, p[v]);
+            if (hv != hops.get(s, v))
+            {
+                touch(s, v);
+                hops.set(s, v, hv);
+            }
+        }
+    }
+
+    void improve(int s, int v, int dv, Scratch &sc)
+    {
+        int *d = distRow(s);
+        touch(s, v);
+        if (d[v] >= INF)
+            sc.fullScanDelta += out[v].size();
+        if (sc.affected[v] != sc.stamp)
+        {
+            sc.affected[v] = sc.stamp;
+            sc.changedNodes.push_back(v);
+        }
+        d[v] = dv;
+        sc.heap.push_back(make_pair(dv, v));
+        push_heap(sc.heap.begin(), sc.heap.end(), greater<pair<int, int>>());
+    }
+
+    void markForReselect(int v, Scratch &sc)
+    {
+        if (sc.reselected[v] != sc.stamp)
+        {
+            sc.reselected[v] = sc.stamp;
+            sc.reselect.push_back(v);
+        }
+    }
+
+    // The zero-cost fallback: a full Dijkstra run for source s, touching what differs.
+    void recomputeSource(int s, const CSRGraph &csr, DijkstraScratch &ds, Scratch &sc)
+    {
+        vector<int> oldDist(distRow(s), distRow(s) + n);
+        dijkstra(csr, s, distRow(s), prevRow(s), sc.firstHop.data(), ds);
+        for (int v = 0; v < n; ++v)
+        {
+            if (distRow(s)[v] < INF)
+                sc.scanned += out[v].size();
+            if ((oldDist[v] < INF) != (distRow(s)[v] < INF))
+                sc.fullScanDelta += distRow(s)[v] < INF ? (long)out[v].size() : -(long)out[v].size();
+            int oldHop = hops.get(s, v);
+            if (oldDist[v] != distRow(s)[v] || oldHop != sc.firstHop[v])
+            {
+                TouchedEntry entry = {v, min(oldDist[v], INF), oldHop};
+                touched[s].push_back(entry);
+            }
+        }
+        hops.setRow(s, sc.firstHop.data());
+    }
+
+    int n;
+    WorkStealingPool &pool;
+    vector<vector<Link>> out, in; // links by source and by target, each sorted by the other end
+    vector<int> distances, prevs; // row s: source s's dist[] and prev[]
+    NextHopMatrix hops;           // row s: source s's first hops
+    vector<vector<TouchedEntry>> touched; // per source, entries modified by the current event
+    vector<Scratch> scratch;
+    long zeroLinks; // links u -> v (u != v) of cost 0
+    long long fullScan;
+};
+
+/**
+ * simulateLSREvents
+ * -----------------
+ * Prints the LSR tables like simulateLSR, then applies the events one by one
+ * and prints, for each, the table entries it changed and the work it took
+ * compared with recomputing every table.
+ *
+ * Parameters: graph    The network.
+ *             events   Link changes, in order.
+ *             threads  Number of worker threads.
+ *             tables   Where the initial tables are written.
+ */
+void simulateLSREvents(const CSRGraph &graph, const vector<LinkEvent> &events, int threads, TableWriter &tables)
+{
+    WorkStealingPool pool(threads);
+    DynamicRoutes routes(graph, pool);
+    int n = routes.size();
+    tables.write(PROTOCOL_LSR, 0, n, n, [&](int s, const int *&cost, HopRow &hop)
+                 {
+                     cost = routes.dist(s);
+                     hop = routes.hop(s);
+                 });
+
+    cout << "--- Link State Routing Updates ---\n";
+    for (size_t k = 0; k < events.size(); ++k)
+    {
+        const LinkEvent &event = events[k];
+        EventReport report = routes.apply(event);
+        cout << "Event " << k + 1 << ": " << event.kind << " " << event.u << " " << event.v;
+        if (event.kind != "down")
+            cout << " " << event.cost;
+        cout << "\n";
+        cout << "Node\tDest\tCost\tNext Hop\n";
+        for (size_t c = 0; c < report.changes.size(); ++c)
+        {
+            const RouteChange &change = report.changes[c];
+            cout << change.src << "\t" << change.dest << "\t";
+            if (change.cost >= INF)
+                cout << "INF\t";
+            else
+                cout << change.cost << "\t";
+            if (change.hop == -1)
+                cout << "-";
+            else
+                cout << change.hop;
+            cout << "\n";
+        }
+        cout << "Changed " << report.changes.size() << " entries in " << report.tables << " tables; scanned "
+             << report.scanned << " links (a full recompute scans " << report.fullScan << "), " << fixed
+             << setprecision(3) << report.ms << " ms\n"
+             << endl;
+        cout.unsetf(ios::fixed);
+    }
+}
+
+// Horizon
+// -------
+// What a DVR node advertises to the neighbor it routes a destination through:
+// its cost as usual (none), nothing (split horizon), or infinity (poison reverse).
+enum Horizon
+{
+    HORIZON_NONE,
+    HORIZON_SPLIT,
+    HORIZON_POISON
+};
+
+const char *horizonName(Horizon horizon)
+{
+    return horizon == HORIZON_SPLIT ? "split horizon" : horizon == HORIZON_POISON ? "poison reverse" : "no split horizon";
+}
+
+// ScenarioEvent
+// -------------
+// A link change scheduled at a tick (one tick is one exchange round).
+struct ScenarioEvent
+{
+    int tick;
+    LinkEvent change;
+};
+
+// ScenarioOutcome
+// ---------------
+// How the network converged after an event (or, for the first one, from the
+// initial topology). rounds is -1 if the next event came first. A loop is a
+// destination whose next hops, followed from some node, go round in a cycle.
+struct ScenarioOutcome
+{
+    int tick;
+    string label;
+    int rounds;
+    DVRMetrics metrics;
+    int loopRounds;       // rounds that ended with at least one loop
+    int maxLoops;         // most destinations in a loop at the end of a round
+    int loopDestinations; // destinations that were in a loop at some point
+};
+
+// DVRNetwork
+// ----------
+// A distance vector network in which links fail and change, for scenarios.
+// Unlike exchangeDistanceVectors, which only handles costs going down, every
+// node keeps the last vector each neighbor sent it, one row per link, and its
+// route to k is the best of (link cost + what the neighbor advertised for k).
+// When the neighbor it routes through advertises a higher cost, the node has
+// to accept it, which is how bad news travels and how counting to infinity
+// happens. Costs are capped at the scenario's infinity, which means
+// unreachable.
+//
+// A round is synchronous: every node sends each neighbor the entries of its
+// vector that changed since it last told that neighbor, as they are at the
+// start of the round, and then all the messages are delivered.
+//
+// With split horizon a node says nothing to the neighbor it routes through,
+// so that neighbor keeps the last cost it heard; as in RIP, such a route
+// expires DVR_ROUTE_TIMEOUT rounds after it stopped being advertised.
+class DVRNetwork
+{
+public:
+    DVRNetwork(const CSRGraph &graph, Horizon horizon, int infinity)
+        : n(graph.n), infinity(infinity), horizon(horizon), links(n), learners(n), dist((size_t)n * n, infinity),
+          hop((size_t)n * n, -1), pending(n), isPending((size_t)n * n, 0), isDirty(n, 0), looped(n, 0), loopCount(0),
+          seen(n, -1), generation(0), roundCount(0)
+    {
+        for (int i = 0; i < n; ++i)
+            setRoute(i, i, 0, -1);
+        for (int i = 0; i < n; ++i)
+            for (int e = graph.offset[i]; e < graph.offset[i + 1]; ++e)
+                if (graph.target[e] != i && graph.cost[e] < INF)
+                    setLink(i, graph.target[e], graph.cost[e]);
+    }
+
+    // Sets the cost of link a -> b, over which a learns b's vector (INF: the link is down).
+    void setLink(int a, int b, int cost)
+    {
+        vector<int>::iterator it = links[a].begin();
+        while (it != links[a].end() && slotFrom[*it] < b)
+            ++it;
+        bool exists = it != links[a].end() && slotFrom[*it] == b;
+        if (cost >= INF)
+        {
+            if (!exists)
+                return;
+            int slot = *it;
+            links[a].erase(it);
+            for (size_t l = 0; l < learners[b].size(); ++l)
+                if (learners[b][l].second == slot)
+                    learners[b].erase(learners[b].begin() + l--);
+            freeSlots.push_back(slot);
+            for (int k = 0; k < n; ++k)
+                if (hop[(size_t)a * n + k] == b)
+                    reselect(a, k);
+            return;
+        }
+        if (!exists)
+        {
+            // A new neighbor: all a knows of it is that it reaches itself
+            int slot = allocateSlot(a, b, cost);
+            links[a].insert(it, slot);
+            learners[b].push_back(make_pair(a, slot));
+            for (int k = 0; k < n; ++k)
+                if (dist[(size_t)b * n + k] < infinity)
+                    markPending(b, k); // b sends a its vector in the next round
+        }
+        else
+            slotCost[*it] = cost;
+        for (int k = 0; k < n; ++k)
+            if (k != a)
+                reselect(a, k);
+    }
+
+    // One round; returns false if no node had anything to send and no route is waiting to expire.
+    bool round(DVRMetrics &metrics)
+    {
+        ++roundCount;
+        while (!expiring.empty() && expiring.front().due <= roundCount)
+        {
+            expire(expiring.front());
+            expiring.pop_front();
+        }
+        outbox.clear();
+        for (int j = 0; j < n; ++j)
+        {
+            if (pending[j].empty())
+                continue;
+            for (size_t l = 0; l < learners[j].size(); ++l)
+            {
+                int i = learners[j][l].first;
+                int slot = learners[j][l].second;
+                size_t before = outbox.size();
+                for (size_t p = 0; p < pending[j].size(); ++p)
+                {
+                    int k = pending[j][p];
+                    int cost = dist[(size_t)j * n + k];
+                    if (hop[(size_t)j * n + k] == i && horizon == HORIZON_SPLIT)
+                    {
+                        // Not told at all: i keeps what it had until it times out
+                        if (advertised[(size_t)slot * n + k] < infinity)
+                        {
+                            Expiry expiry = {roundCount + DVR_ROUTE_TIMEOUT, i, j, k};
+                            expiring.push_back(expiry);
+                        }
+                        continue;
+                    }
+                    if (hop[(size_t)j * n + k] == i && horizon == HORIZON_POISON)
+                        cost = infinity;
+                    if (cost != advertised[(size_t)slot * n + k])
+                    {
+                        Update update = {i, slot, k, cost};
+                        outbox.push_back(update);
+                    }
+                }
+                if (outbox.size() > before)
+                {
+                    ++metrics.messages;
+                    metrics.entries += outbox.size() - before;
+                }
+            }
+            for (size_t p = 0; p < pending[j].size(); ++p)
+                isPending[(size_t)j * n + pending[j][p]] = 0;
+            pending[j].clear();
+        }
+        for (size_t u = 0; u < outbox.size(); ++u)
+        {
+            const Update &update = outbox[u];
+            advertised[(size_t)update.slot * n + update.dest] = update.cost;
+            reselect(update.receiver, update.dest);
+        }
+        return !outbox.empty() || !expiring.empty();
+    }
+
+    // Rechecks the destinations whose routes changed; returns how many are in a loop.
+    int updateLoops()
+    {
+        for (size_t d = 0; d < dirty.size(); ++d)
+        {
+            int k = dirty[d];
+            isDirty[k] = 0;
+            bool loop = hasLoop(k);
+            loopCount += loop - looped[k];
+            looped[k] = loop;
+        }
+        dirty.clear();
+        return loopCount;
+    }
+
+    bool inLoop(int k) const { return looped[k]; }
+
+private:
+    struct Update
+    {
+        int receiver, slot, dest, cost;
+    };
+
+    struct Expiry
+    {
+        long due;
+        int receiver, sender, dest;
+    };
 
+    // Forgets the sender's entry if it still isn't advertised to the receiver.
+    void expire(const Expiry &expiry)
+    {
+        int i = expiry.receiver, j = expiry.sender, k = expiry.dest;
+        if (hop[(size_t)j * n + k] != i)
+            return; // advertised again since
+        for (size_t l = 0; l < links[i].size(); ++l)
+        {
+            int slot = links[i][l];
+            if (slotFrom[slot] == j && advertised[(size_t)slot * n + k] < infinity)
+            {
+                advertised[(size_t)slot * n + k] = infinity;
+                reselect(i, k);
+            }
+        }
+    }
+
+    int allocateSlot(int a, int b, int cost)
+    {
+        int slot;
+        if (freeSlots.empty())
+        {
+            slot = slotFrom.size();
+            slotFrom.push_back(b);
+            slotCost.push_back(cost);
+            advertised.resize(advertised.size() + n);
+        }
+        else
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            slotFrom[slot] = b;
+            slotCost[slot] = cost;
+        }
+        fill(advertised.begin() + (size_t)slot * n, advertised.begin() + (size_t)(slot + 1) * n, infinity);
+        advertised[(size_t)slot * n + b] = 0;
+        (void)a;
+        return slot;
+    }
+
+    // Node i's best route to k over its links; on a tie the current next hop stays,
+    // otherwise the lowest-numbered neighbor wins.
+    void reselect(int i, int k)
+    {
+        if (k == i)
+            return;
+        int current = hop[(size_t)i * n + k];
+        int best = infinity, bestHop = -1;
+        for (size_t l = 0; l < links[i].size(); ++l)
+        {
+            int slot = links[i][l];
+            int cost = min(slotCost[slot] + advertised[(size_t)slot * n + k], infinity);
+            if (cost < best || (cost == best && cost < infinity && slotFrom[slot] == current))
+            {
+                best = cost;
+                bestHop = slotFrom[slot];
+            }
+        }
+        setRoute(i, k, best, bestHop);
+    }
+
+    void setRoute(int i, int k, int cost, int next)
+    {
+        size_t entry = (size_t)i * n + k;
+        if (cost >= infinity)
+        {
+            cost = infinity;
+            next = -1;
+        }
+        if (dist[entry] == cost && hop[entry] == next)
+            return;
+        dist[entry] = cost;
+        hop[entry] = next;
+        markPending(i, k);
+        if (!isDirty[k])
+        {
+            isDirty[k] = 1;
+            dirty.push_back(k);
+        }
+    }
+
+    void markPending(int i, int k)
+    {
+        if (!isPending[(size_t)i * n + k])
+        {
+            isPending[(size_t)i * n + k] = 1;
+            pending[i].push_back(k);
+        }
+    }
+
+    // Follows the next hops towards k from every node; a walk that comes back on
+    // itself before reaching k (or a node without a route) is a loop.
+    bool hasLoop(int k)
+    {
+        generation += n;
+        for (int start = 0; start < n; ++start)
+        {
+            int x = start;
+            while (x != -1 && x != k && seen[x] < generation)
+            {
+                seen[x] = generation + start;
+                x = hop[(size_t)x * n + k];
+            }
+            if (x != -1 && x != k && seen[x] == generation + start)
+                return true;
+        }
+        return false;
+    }
+
+    int n;
+    int infinity;
+    Horizon horizon;
+    vector<vector<int>> links;               // links[i]: slots of i's links, by neighbor
+    vector<vector<pair<int, int>>> learners; // learners[j]: (i, slot) for every link i -> j
+    vector<int> slotFrom, slotCost;          // the neighbor and cost of each slot's link
+    vector<int> advertised;                  // slot s: the vector last received over it, n entries
+    vector<int> freeSlots;
+    vector<int> dist, hop;                   // n x n: each node's routes
+    vector<vector<int>> pending;             // pending[i]: destinations changed since i last sent
+    vector<char> isPending;
+    vector<Update> outbox;
+    vector<int> dirty;                       // destinations whose routes changed since updateLoops()
+    vector<char> isDirty, looped;
+    int loopCount;
+    vector<long long> seen;
+    long long generation;
+    long roundCount;
+    deque<Expiry> expiring; // split horizon: routes no longer advertised, by due round
+};
+
+// runScenario
+// -----------
+// Runs the DVR exchange on the topology until it converges, then applies the
+// events at their ticks (ticks without traffic are skipped) and lets the
+// network converge again after each, recording what it took.
+//
+// Parameters:
+// - graph: The initial topology.
+// - events: Link changes, sorted by tick.
+// - horizon, infinity: The DVR variant.
+vector<ScenarioOutcome> runScenario(const CSRGraph &graph,
+                                    const vector<ScenarioEvent> &events,
+                                    Horizon horizon,
+                                    int infinity)
+{
+    int n = graph.n;
+    DVRNetwork network(graph, horizon, infinity);
+    vector<ScenarioOutcome> outcomes;
+    vector<int> loopedIn(n, -1); // the outcome in which each destination was last in a loop
+    size_t next = 0;
+    int tick = 0;
+    while (true)
+    {
+        if (outcomes.empty() || (next < events.size() && events[next].tick <= tick))
+        {
+            ScenarioOutcome outcome = {tick, "initial", -1, DVRMetrics(), 0, 0, 0};
+            for (; next < events.size() && events[next].tick <= tick; ++next)
+            {
+                const LinkEvent &change = events[next].change;
+                network.setLink(change.u, change.v, change.cost);
+                network.setLink(change.v, change.u, change.cost);
+                ostringstream label;
+                label << change.kind << " " << change.u << " " << change.v;
+                if (change.kind != "down")
+                    label << " " << change.cost;
+                outcome.label = outcomes.empty() ? "initial, " + label.str() : label.str();
+            }
+            outcomes.push_back(outcome);
+        }
+        ScenarioOutcome &outcome = outcomes.back();
+        bool sent = network.round(outcome.metrics);
+        int loops = network.updateLoops();
+        if (loops > 0)
+        {
+            ++outcome.loopRounds;
+            outcome.maxLoops = max(outcome.maxLoops, loops);
+            for (int k = 0; k < n; ++k)
+            {
+                if (network.inLoop(k) && loopedIn[k] != (int)outcomes.size())
+                {
+                    loopedIn[k] = outcomes.size();
+                    ++outcome.loopDestinations;
+                }
+            }
+        }
+        if (sent)
+        {
+            ++tick;
+            continue;
+        }
+        outcome.rounds = tick - outcome.tick;
+        if (next == events.size())
+            break;
+        tick = max(tick, events[next].tick);
+    }
+    return outcomes;
+}
+
+// simulateDVRScenarios
+// --------------------
+// Runs the scenario for every combination of the given horizon variants and
+// infinity values, the runs spread over the threads, and prints for each
+// event of each run the rounds, messages and loops until convergence.
+void simulateDVRScenarios(const CSRGraph &graph,
+                          const vector<ScenarioEvent> &events,
+                          const vector<Horizon> &horizons,
+                          const vector<int> &infinities,
+                          int threads)
+{
+    int runs = horizons.size() * infinities.size();
+    vector<vector<ScenarioOutcome>> results(runs);
+    WorkStealingPool pool(min(threads, runs));
+    pool.run(runs, [&](int, int r)
+             { results[r] = runScenario(graph, events, horizons[r / infinities.size()], infinities[r % infinities.size()]); });
+
+    for (int r = 0; r < runs; ++r)
+    {
+        cout << "--- Scenario: " << horizonName(horizons[r / infinities.size()]) << ", infinity "
+             << infinities[r % infinities.size()] << " ---\n";
+        for (size_t e = 0; e < results[r].size(); ++e)
+        {
+            const ScenarioOutcome &outcome = results[r][e];
+            cout << "Tick " << outcome.tick << ": " << outcome.label << ": ";
+            if (outcome.rounds < 0)
+                cout << "not converged before the next event";
+            else
+                cout << "converged in " << outcome.rounds << " rounds";
+            cout << ", " << outcome.metrics.messages << " messages (" << outcome.metrics.bytes() << " bytes)";
+            if (outcome.loopRounds > 0)
+                cout << "; loops in " << outcome.loopRounds << " rounds, looping destinations: at most "
+                     << outcome.maxLoops << " at once, " << outcome.loopDestinations << " in all";
+            else
+                cout << "; no loops";
+            cout << "\n";
+        }
+        cout << endl;
+    }
+}
+
+/**
+ * MappedFile
+ * ----------
+ * A file mapped read-only into memory for as long as the object lives.
+ */
+struct MappedFile
+{
+    const char *data;
+    size_t size;
+
+    MappedFile() : data(nullptr), size(0) {}
+    ~MappedFile()
+    {
+        if (size > 0)
+            munmap((void *)data, size);
+    }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+shared_ptr<MappedFile> mapFile(const string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        cerr << "Error: Cannot open input file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+    shared_ptr<MappedFile> file = make_shared<MappedFile>();
+    if (st.st_size > 0)
+    {
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            cerr << "Error: Cannot map input file '" << filename << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        file->data = (const char *)data;
+        file->size = st.st_size;
+    }
+    close(fd);
+    return file;
+}
+
+/**
+ * TextParser
+ * ----------
+ * Reads whitespace-separated integers straight from a mapped text file,
+ * without the locale and stream machinery of ifstream >>. Lines starting with
+ * '#' are skipped when comments are allowed.
+ */
+struct TextParser
+{
+    const char *p;
+    const char *end;
+    bool comments;
+
+    // The next integer, false at the end of the file or if something else comes next.
+    // Values too large for an int are clamped.
+    bool next(long &value)
+    {
+        skipBlanks();
+        const char *start = p;
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            ++p;
+        long magnitude = 0;
+        const char *digits = p;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            magnitude = min(magnitude * 10 + (*p - '0'), 1L << 40);
+        if (p == digits)
+        {
+            p = start;
+            return false;
+        }
+        magnitude = min(magnitude, (long)numeric_limits<int>::max());
+        value = negative ? -magnitude : magnitude;
+        return true;
+    }
+
+    // Numbers on the current line, from here on
+    int countOnLine()
+    {
+        skipBlanks();
+        const char *saved = p;
+        int count = 0;
+        long value;
+        while (true)
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+                ++p;
+            if (p == end || *p == '\n' || !next(value))
+                break;
+            ++count;
+        }
+        p = saved;
+        return count;
+    }
+
+    void skipBlanks()
+    {
+        while (p < end)
+        {
+            if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+                ++p;
+            else if (comments && *p == '#')
+                while (p < end && *p != '\n')
+                    ++p;
+            else
+                break;
+        }
+    }
+};
+
+// The line number of position p in the file, for error messages
+long lineOf(const MappedFile &file, const char *p)
+{
+    return 1 + count(file.data, p, '\n');
+}
+
+// How a stored cost relates to the topology's: no entry (-1) for a negative
+// cost or INF, costs above INF capped at 2 * INF (see CSRGraph).
+int entryCost(long cost)
+{
+    if (cost < 0 || cost == INF)
+        return -1;
+    return min(cost, 2L * INF);
+}
+
+/**
+ * TopologyFile
+ * ------------
+ * What readGraphFromFile found: the file's format and where the topology
+ * ends (a scenario's events follow it).
+ */
+struct TopologyFile
+{
+    string format;
+    size_t end;
+};
+
+const char CSR_FILE_MAGIC[4] = {'C', 'S', 'R', 'G'};
+const uint32_t CSR_FILE_VERSION = 1;
+
+// Header of a binary CSR file, followed by offset[n + 1], target[entries] and
+// cost[entries], all 32-bit little-endian.
+struct CSRFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t n;
+    uint32_t entries;
+};
+
+// The n x n matrix, streamed row by row into CSR form. As with ifstream >>,
+// reading stops at the first thing that isn't a number; missing cells are INF.
+CSRGraph parseMatrix(TextParser &parser, const MappedFile &file, const string &filename)
+{
+    long n = 0;
+    parser.skipBlanks();
+    const char *header = parser.p;
+    parser.next(n);
+    if (n < 0)
+    {
+        cerr << "Error: Invalid node count on line " << lineOf(file, header) << " of '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+    vector<int> offset(1, 0), target, cost;
+    bool more = true;
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+        {
+            long value;
+            more = more && parser.next(value);
+            int c = more ? entryCost(value) : -1;
+            if (c >= 0)
+            {
+                target.push_back(j);
+                cost.push_back(c);
+            }
+        }
+        offset.push_back(target.size());
+    }
+    return makeCSR(n, offset, target, cost);
+}
+
+// "n m", then m lines "u v cost", each a link u -> v. Duplicates keep the lowest
+// cost. A node without a "u u cost" line has cost 0 to itself, as on the
+// diagonal of a matrix file ("u u -1": no entry).
+CSRGraph parseEdgeList(TextParser &parser, const MappedFile &file, const string &filename)
+{
+    long n = 0, m = 0;
+    parser.skipBlanks();
+    const char *header = parser.p;
+    if (!parser.next(n) || !parser.next(m) || n <= 0 || m < 0)
+    {
+        cerr << "Error: Invalid header on line " << lineOf(file, header) << " of '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+    // A link line takes at least 6 bytes, so a count larger than the file allows reserves no more
+    long expected = min(m, (long)(parser.end - parser.p) / 6 + 1);
+    vector<int> from, to, linkCost;
+    from.reserve(expected);
+    to.reserve(expected);
+    linkCost.reserve(expected);
+    vector<char> hasSelf(n, 0);
+    for (long k = 0; k < m; ++k)
+    {
+        long u, v, c;
+        parser.skipBlanks();
+        const char *line = parser.p;
+        if (!parser.next(u) || !parser.next(v) || !parser.next(c) || u < 0 || u >= n || v < 0 || v >= n)
+        {
+            cerr << "Error: Invalid link on line " << lineOf(file, line) << " of '" << filename << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        if (u == v)
+            hasSelf[u] = 1;
+        if (entryCost(c) < 0)
+            continue;
+        from.push_back(u);
+        to.push_back(v);
+        linkCost.push_back(entryCost(c));
+    }
+    for (int u = 0; u < n; ++u)
+    {
+        if (!hasSelf[u])
+        {
+            from.push_back(u);
+            to.push_back(u);
+            linkCost.push_back(0);
+        }
+    }
+
+    // Counting sort by source, then each node's entries by target
+    vector<int> offset(n + 1, 0);
+    for (size_t k = 0; k < from.size(); ++k)
+        ++offset[from[k] + 1];
+    for (int u = 0; u < n; ++u)
+        offset[u + 1] += offset[u];
+    vector<pair<int, int>> entries(from.size());
+    vector<int> fill(offset.begin(), offset.end() - 1);
+    for (size_t k = 0; k < from.size(); ++k)
+        entries[fill[from[k]]++] = make_pair(to[k], linkCost[k]);
+    vector<int> target, cost;
+    target.reserve(entries.size());
+    cost.reserve(entries.size());
+    vector<int> compact(1, 0);
+    for (int u = 0; u < n; ++u)
+    {
+        sort(entries.begin() + offset[u], entries.begin() + offset[u + 1]);
+        for (int e = offset[u]; e < offset[u + 1]; ++e)
+        {
+            if (e > offset[u] && entries[e].first == entries[e - 1].first)
+                continue; // a duplicate, with a higher cost
+            target.push_back(entries[e].first);
+            cost.push_back(entries[e].second);
+        }
+        compact.push_back(target.size());
+    }
+    return makeCSR(n, compact, target, cost);
+}
+
+// The arrays of a binary CSR file are used in place, in the mapping. Costs must be
+// ones the text parsers could have stored (see entryCost): no INF, nothing above
+// 2 * INF, so that d + cost cannot overflow and a converted file behaves like its source.
+CSRGraph mapBinaryCSR(const shared_ptr<MappedFile> &file, const string &filename)
+{
+    CSRFileHeader header;
+    memcpy(&header, file->data, sizeof(header));
+    size_t expected = sizeof(header) + 4 * ((size_t)header.n + 1 + 2 * (size_t)header.entries);
+    CSRGraph graph;
+    graph.n = header.n;
+    graph.offset = (const int *)(file->data + sizeof(header));
+    graph.target = graph.offset + header.n + 1;
+    graph.cost = graph.target + header.entries;
+    graph.storage = file;
+    bool valid = header.version == CSR_FILE_VERSION && file->size == expected && header.n <= (uint32_t)INT32_MAX &&
+                 header.entries <= (uint32_t)INT32_MAX && graph.offset[0] == 0 &&
+                 graph.offset[header.n] == (int)header.entries;
+    for (int u = 0; valid && u < graph.n; ++u)
+        valid = graph.offset[u] <= graph.offset[u + 1];
+    for (uint32_t e = 0; valid && e < header.entries; ++e)
+        valid = graph.target[e] >= 0 && graph.target[e] < graph.n && entryCost(graph.cost[e]) == graph.cost[e];
+    if (!valid)
+    {
+        cerr << "Error: '" << filename << "' is not a valid binary CSR file\n";
+        exit(EXIT_FAILURE);
+    }
+    return graph;
+}
+
+/**
+ * readGraphFromFile
+ * -----------------
+ * Reads a network topology in any of three formats, told apart by their start:
+ *  - matrix: the first line contains an integer n, the number of nodes. The
+ *    following n lines each contain n space-separated integers, representing
+ *    the adjacency matrix of link costs;
+ *  - edge list: a first line "n m", then m lines "u v cost" ('#' comments allowed);
+ *  - binary CSR (written by --convert): used in place from a single mmap.
+ * The text formats are parsed straight from the mapped file, and a matrix is
+ * never held as n x n: only its entries are kept.
+ *
+ *  filename  --> Path to the input file
+ *  source    --> If not null, receives the format and where the topology ends
+ * returns         The network in CSR form
+ */
+CSRGraph readGraphFromFile(const string &filename, TopologyFile *source = nullptr)
+{
+    shared_ptr<MappedFile> file = mapFile(filename);
+    TopologyFile found;
+    CSRGraph graph;
+    if (file->size >= sizeof(CSRFileHeader) && memcmp(file->data, CSR_FILE_MAGIC, 4) == 0)
+    {
+        graph = mapBinaryCSR(file, filename);
+        found.format = "binary CSR";
+        found.end = file->size;
+    }
+    else
+    {
+        TextParser parser = {file->data, file->data + file->size, true};
+        if (parser.countOnLine() == 2)
+        {
+            graph = parseEdgeList(parser, *file, filename);
+            found.format = "edge list";
+        }
+        else
+        {
+            parser.comments = false;
+            graph = parseMatrix(parser, *file, filename);
+            found.format = "matrix";
+        }
+        found.end = parser.p - file->data;
+    }
+    if (source)
+        *source = found;
+    return graph;
+}
+
+/**
+ * writeGraphToFile
+ * ----------------
+ * Writes the topology as a binary CSR file if filename ends in ".csr", as an
+ * edge list otherwise; readGraphFromFile() reads either back unchanged.
+ *
+ *  graph     --> The network
+ *  filename  --> Path to the output file
+ */
+void writeGraphToFile(const CSRGraph &graph, const string &filename)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        cerr << "Error: Cannot create output file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+    int n = graph.n;
+    if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csr") == 0)
+    {
+        CSRFileHeader header;
+        memcpy(header.magic, CSR_FILE_MAGIC, 4);
+        header.version = CSR_FILE_VERSION;
+        header.n = n;
+        header.entries = graph.entries();
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(graph.offset, sizeof(int), n + 1, file);
+        fwrite(graph.target, sizeof(int), graph.entries(), file);
+        fwrite(graph.cost, sizeof(int), graph.entries(), file);
+    }
+    else
+    {
+        // The diagonal is only written where it isn't the default 0
+        long lines = 0;
+        for (int u = 0; u < n; ++u)
+        {
+            bool self = false;
+            for (int e = graph.offset[u]; e < graph.offset[u + 1]; ++e)
+            {
+                self = self || graph.target[e] == u;
+                lines += graph.target[e] != u || graph.cost[e] != 0;
+            }
+            lines += !self;
+        }
+        fprintf(file, "%d %ld\n", n, lines);
+        for (int u = 0; u < n; ++u)
+        {
+            bool self = false;
+            for (int e = graph.offset[u]; e < graph.offset[u + 1]; ++e)
+            {
+                int v = graph.target[e];
+                self = self || v == u;
+                if (v != u || graph.cost[e] != 0)
+                    fprintf(file, "%d %d %d\n", u, v, graph.cost[e]);
+            }
+            if (!self)
+                fprintf(file, "%d %d -1\n", u, u);
+        }
+    }
+    if (fclose(file) != 0)
+    {
+        cerr << "Error: Cannot write output file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * parseLinkEvent
+ * --------------
+ * Parses "up <u> <v> <cost>", "cost <u> <v> <cost>" or "down <u> <v>" from
+ * fields, of which kind is the first word, on nodes 0 .. n-1. As in the
+ * topology file, a negative cost means no link.
+ *
+ * returns         False if the event is malformed
+ */
+bool parseLinkEvent(istream &fields, const string &kind, int n, LinkEvent &event)
+{
+    event.kind = kind;
+    event.cost = INF;
+    bool valid = fields >> event.u >> event.v && event.u >= 0 && event.u < n && event.v >= 0 && event.v < n &&
+                 event.u != event.v;
+    if (kind == "up" || kind == "cost")
+        valid = valid && fields >> event.cost;
+    else if (kind != "down")
+        valid = false;
+    if (event.cost < 0 || event.cost >= INF)
+        event.cost = INF;
+    return valid;
+}
+
+/**
+ * readEventsFromFile
+ * ------------------
+ * Reads link events, one per line (see parseLinkEvent): link u-v comes up
+ * with a cost, changes its cost or goes down. Empty lines and lines starting
+ * with '#' are skipped.
+ *
+ *  filename  --> Path to the events file
+ *  n         --> Number of nodes of the topology
+ * returns         The events, in file order
+ */
+vector<LinkEvent> readEventsFromFile(const string &filename, int n)
+{
+    ifstream file(filename);
+    if (!file.is_open())
+    {
+        cerr << "Error: Cannot open events file '" << filename << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    vector<LinkEvent> events;
+    string line;
+    for (int number = 1; getline(file, line); ++number)
+    {
+        istringstream fields(line);
+        string kind;
+        if (!(fields >> kind) || kind[0] == '#')
+            continue;
+        LinkEvent event;
+        if (!parseLinkEvent(fields, kind, n, event))
+        {
+            cerr << "Error: Invalid event on line " << number << " of '" << filename << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        events.push_back(event);
+    }
+    return events;
+}
+
+/**
+ * readScenarioFromFile
+ * --------------------
+ * Reads the events of a scenario file: a topology file (matrix or edge list)
+ * followed by lines "<tick> <event>", the event as in the events file, e.g.
+ * "12 down 0 3". Empty lines and lines starting with '#' are skipped. A
+ * topology file without events is a scenario with none.
+ *
+ *  filename  --> Path to the scenario file
+ *  start     --> Where the topology ends (see readGraphFromFile)
+ *  n         --> Number of nodes of the topology
+ * returns         The events, sorted by tick (file order within a tick)
+ */
+vector<ScenarioEvent> readScenarioFromFile(const string &filename, size_t start, int n)
+{
+    ifstream file(filename);
+    file.seekg(start);
+
+    vector<ScenarioEvent> events;
+    string line;
+    while (getline(file, line))
+    {
+        istringstream fields(line);
+        string first, kind;
+        if (!(fields >> first) || first[0] == '#')
+            continue;
+        ScenarioEvent event;
+        istringstream tick(first);
+        if (!(tick >> event.tick) || event.tick < 0 || !(fields >> kind) ||
+            !parseLinkEvent(fields, kind, n, event.change))
+        {
+            cerr << "Error: Invalid scenario event '" << line << "' in '" << filename << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        events.push_back(event);
+    }
+    stable_sort(events.begin(), events.end(), [](const ScenarioEvent &a, const ScenarioEvent &b)
+                { return a.tick < b.tick; });
+    return events;
+}
+
+// Splits a comma-separated option value ("none,poison") into its items.
+vector<string> splitList(const string &list)
+{
+    vector<string> items;
+    istringstream stream(list);
+    string item;
+    while (getline(stream, item, ','))
+        items.push_back(item);
+    return items;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = max(1u, thread::hardware_concurrency());
+    string dvrMode = "sweep";
+    string eventsFile;
+    string convertFile;
+    string timingFile;
+    string tablesFile;
+    bool quiet = false;
+    vector<Horizon> horizons(1, HORIZON_NONE);
+    vector<int> infinities(1, INF);
+    bool valid = argc >= 2;
+    for (int a = 2; valid && a < argc; a += 2)
+    {
+        string option = argv[a];
+        if (option == "--quiet")
+        {
+            quiet = true;
+            --a; // takes no value
+        }
+        else if (a + 1 >= argc)
+            valid = false;
+        else if (option == "--threads")
+            threads = atoi(argv[a + 1]);
+        else if (option == "--dvr")
+            dvrMode = argv[a + 1];
+        else if (option == "--events")
+            eventsFile = argv[a + 1];
+        else if (option == "--convert")
+            convertFile = argv[a + 1];
+        else if (option == "--timing")
+            timingFile = argv[a + 1];
+        else if (option == "--tables")
+            tablesFile = argv[a + 1];
+        else if (option == "--horizon")
+        {
+            vector<string> names = splitList(argv[a + 1]);
+            horizons.clear();
+            for (size_t h = 0; h < names.size(); ++h)
+            {
+                if (names[h] == "none")
+                    horizons.push_back(HORIZON_NONE);
+                else if (names[h] == "split")
+                    horizons.push_back(HORIZON_SPLIT);
+                else if (names[h] == "poison")
+                    horizons.push_back(HORIZON_POISON);
+                else
+                    valid = false;
+            }
+        }
+        else if (option == "--infinity")
+        {
+            vector<string> values = splitList(argv[a + 1]);
+            infinities.clear();
+            for (size_t v = 0; v < values.size(); ++v)
+            {
+                infinities.push_back(atoi(values[v].c_str()));
+                valid = valid && infinities.back() > 0 && infinities.back() <= INF;
+            }
+        }
+        else
+            valid = false;
+    }
+    if (!valid || threads < 1 || horizons.empty() || infinities.empty() ||
+        (dvrMode != "sweep" && dvrMode != "exchange" && dvrMode != "scenario"))
+    {
+        cerr << "Usage: " << argv[0] << " <topology_file> [--threads <n>] [--dvr sweep|exchange|scenario] [--events <file>]\n"
+             << "       [--convert <file>[.csr]] [--horizon none|split|poison[,...]] [--infinity <cost>[,...]]\n"
+             << "       [--tables <file>[.csv|.bin]] [--quiet] [--timing <file>]\n";
+        return EXIT_FAILURE;
+    }
+
+    string filename = argv[1];
+    // Load network topology from file
+    TopologyFile source;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    CSRGraph graph = readGraphFromFile(filename, &source);
+    double loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (!convertFile.empty())
+    {
+        start = chrono::steady_clock::now();
+        writeGraphToFile(graph, convertFile);
+        double writeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "Loaded " << graph.n << " nodes, " << graph.entries() << " entries (" << source.format << ") in "
+             << fixed << setprecision(1) << loadMs << " ms; wrote " << convertFile << " in " << writeMs << " ms\n";
+        return EXIT_SUCCESS;
+    }
+    vector<LinkEvent> events;
+    if (!eventsFile.empty())
+        events = readEventsFromFile(eventsFile, graph.n);
+    TableWriter tables(threads);
+    if (quiet)
+        tables.quiet();
+    else if (!tablesFile.empty())
+        tables.open(tablesFile);
+
+    start = chrono::steady_clock::now();
+    cout << "\n--- Distance Vector Routing Simulation ---\n";
+    if (dvrMode == "exchange")
+        simulateDVRExchange(graph, threads, tables);
+    else if (dvrMode == "scenario")
+        simulateDVRScenarios(graph, readScenarioFromFile(filename, source.end, graph.n), horizons, infinities, threads);
+    else
+        simulateDVR(graph, tables);
+    double dvrMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
     cout << "\n--- Link State Routing Simulation ---\n";
-    simulateLSR(graph);
+    if (eventsFile.empty())
+        simulateLSR(graph, threads, tables);
+    else
+        simulateLSREvents(graph, events, threads, tables);
+    double lsrMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    // Phase times (including any table printing) for routing_bench
+    if (!timingFile.empty())
+    {
+        cout.flush();
+        ofstream timing(timingFile);
+        timing << fixed << setprecision(3) << "load_ms " << loadMs << "\ndvr_ms " << dvrMs << "\nlsr_ms " << lsrMs
+               << "\n";
+        if (!timing)
+        {
+            cerr << "Error: Cannot write timing file '" << timingFile << "'\n";
+            exit(EXIT_FAILURE);
+        }
+    }
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
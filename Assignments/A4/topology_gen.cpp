@@ -0,0 +1,323 @@
+// Synthetic topologies for routing_sim: random (Erdős–Rényi), geometric (Waxman), scale-free
+// (Barabási–Albert), grid and fat-tree networks with weighted bidirectional links, written as an
+// edge list (or an n x n matrix) that routing_sim reads directly. The same seed gives the same file.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+struct GeneratorOptions
+{
+    string model;
+    int n = 0;
+    double degree = 4;   // average links per node (er, waxman, ba)
+    int minCost = 1;     // link costs are drawn uniformly from [minCost, maxCost]
+    int maxCost = 20;
+    double alpha = 0.4;  // Waxman: how fast the link probability falls with distance
+    unsigned long long seed = 1;
+    string format = "edges";  // edges or matrix
+    string output;            // standard output if empty
+};
+
+struct Link
+{
+    int u, v, cost;
+};
+
+/**
+ * Generator
+ * ---------
+ * Builds the links of one topology. Every link is undirected and listed once.
+ */
+class Generator
+{
+public:
+    explicit Generator(const GeneratorOptions &options) : options(options), rng(options.seed) {}
+
+    // Returns false for an unknown model. n may shrink (fat-tree sizes are fixed by k).
+    bool generate(int &n, vector<Link> &links)
+    {
+        if (options.model == "er")
+            erdosRenyi(n, links);
+        else if (options.model == "waxman")
+            waxman(n, links);
+        else if (options.model == "ba")
+            barabasiAlbert(n, links);
+        else if (options.model == "grid")
+            grid(n, links);
+        else if (options.model == "fattree")
+            fatTree(n, links);
+        else
+            return false;
+        return true;
+    }
+
+private:
+    int randomCost()
+    {
+        return uniform_int_distribution<int>(options.minCost, options.maxCost)(rng);
+    }
+
+    void add(vector<Link> &links, int u, int v)
+    {
+        Link link = {u, v, randomCost()};
+        links.push_back(link);
+    }
+
+    // G(n, p) with p chosen for the average degree. Pairs are skipped geometrically
+    // (Batagelj–Brandes), so the time follows the links and not the n²/2 pairs.
+    void erdosRenyi(int n, vector<Link> &links)
+    {
+        double p = n > 1 ? min(1.0, options.degree / (n - 1)) : 0;
+        if (p <= 0)
+            return;
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        double logq = log(1 - p);
+        long long v = 1, w = -1;
+        while (v < n)
+        {
+            double r = uniform(rng);
+            w += 1 + (p < 1 ? (long long)floor(log(1 - r) / logq) : 0);
+            while (w >= v && v < n)
+            {
+                w -= v;
+                ++v;
+            }
+            if (v < n)
+                add(links, (int)w, (int)v);
+        }
+    }
+
+    // Nodes at random points of the unit square; u and v are linked with probability
+    // beta * exp(-d / (alpha * L)), L the largest distance, beta set for the average degree.
+    // The cost grows with the distance. O(n²): meant for a few thousand nodes.
+    void waxman(int n, vector<Link> &links)
+    {
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        vector<double> x(n), y(n);
+        for (int u = 0; u < n; ++u)
+        {
+            x[u] = uniform(rng);
+            y[u] = uniform(rng);
+        }
+        double scale = options.alpha * sqrt(2.0);
+        double weight = 0; // expected links with beta = 1
+        for (int u = 0; u < n; ++u)
+            for (int v = u + 1; v < n; ++v)
+                weight += exp(-hypot(x[u] - x[v], y[u] - y[v]) / scale);
+        double beta = weight > 0 ? min(1.0, options.degree * n / 2 / weight) : 0;
+        for (int u = 0; u < n; ++u)
+        {
+            for (int v = u + 1; v < n; ++v)
+            {
+                double d = hypot(x[u] - x[v], y[u] - y[v]);
+                if (uniform(rng) < beta * exp(-d / scale))
+                {
+                    int cost = options.minCost + (int)lround(d / sqrt(2.0) * (options.maxCost - options.minCost));
+                    Link link = {u, v, cost};
+                    links.push_back(link);
+                }
+            }
+        }
+    }
+
+    // Preferential attachment: each new node links to m = degree / 2 distinct earlier nodes,
+    // picked with probability proportional to their degree. Starts from a clique of m + 1 nodes.
+    void barabasiAlbert(int n, vector<Link> &links)
+    {
+        int m = max(1, (int)lround(options.degree / 2));
+        int core = min(n, m + 1);
+        vector<int> endpoints; // every node once per link it has
+        for (int u = 0; u < core; ++u)
+        {
+            for (int v = u + 1; v < core; ++v)
+            {
+                add(links, u, v);
+                endpoints.push_back(u);
+                endpoints.push_back(v);
+            }
+        }
+        vector<int> picked;
+        for (int v = core; v < n; ++v)
+        {
+            picked.clear();
+            while ((int)picked.size() < m)
+            {
+                int u = endpoints[uniform_int_distribution<size_t>(0, endpoints.size() - 1)(rng)];
+                if (find(picked.begin(), picked.end(), u) == picked.end())
+                    picked.push_back(u);
+            }
+            for (size_t k = 0; k < picked.size(); ++k)
+            {
+                add(links, picked[k], v);
+                endpoints.push_back(picked[k]);
+                endpoints.push_back(v);
+            }
+        }
+    }
+
+    // The nodes row by row on a grid about sqrt(n) wide, each linked to its right and lower neighbors.
+    void grid(int n, vector<Link> &links)
+    {
+        int width = max(1, (int)ceil(sqrt((double)n)));
+        for (int u = 0; u < n; ++u)
+        {
+            if ((u + 1) % width != 0 && u + 1 < n)
+                add(links, u, u + 1);
+            if (u + width < n)
+                add(links, u, u + width);
+        }
+    }
+
+    // The largest k-ary fat tree (k even) with at most n nodes (n >= 7): (k/2)² core switches, then per pod
+    // k/2 aggregation and k/2 edge switches, then k/2 hosts per edge switch; 5k²/4 + k³/4 nodes.
+    void fatTree(int &n, vector<Link> &links)
+    {
+        int k = 2;
+        while (5 * (k + 2) * (k + 2) / 4 + (k + 2) * (k + 2) * (k + 2) / 4 <= n)
+            k += 2;
+        int half = k / 2;
+        int cores = half * half;
+        int aggregation = cores;                 // first aggregation switch
+        int edge = aggregation + k * half;       // first edge switch
+        int hosts = edge + k * half;             // first host
+        n = hosts + k * half * half;
+        for (int pod = 0; pod < k; ++pod)
+        {
+            for (int a = 0; a < half; ++a)
+            {
+                int agg = aggregation + pod * half + a;
+                for (int c = 0; c < half; ++c)
+                    add(links, a * half + c, agg);
+                for (int e = 0; e < half; ++e)
+                    add(links, agg, edge + pod * half + e);
+            }
+            for (int e = 0; e < half; ++e)
+                for (int h = 0; h < half; ++h)
+                    add(links, edge + pod * half + e, hosts + (pod * half + e) * half + h);
+        }
+    }
+
+    GeneratorOptions options;
+    mt19937_64 rng;
+};
+
+/**
+ * writeTopology
+ * -------------
+ * Writes the links in both directions, as an edge list ("n m", then "u v cost"
+ * lines) or as routing_sim's original n x n matrix (9999 where there is no link).
+ */
+bool writeTopology(FILE *file, const string &format, int n, const vector<Link> &links)
+{
+    if (format == "matrix")
+    {
+        vector<int> row(n);
+        vector<vector<Link>> byNode(n);
+        for (size_t k = 0; k < links.size(); ++k)
+        {
+            byNode[links[k].u].push_back(links[k]);
+            Link back = {links[k].v, links[k].u, links[k].cost};
+            byNode[links[k].v].push_back(back);
+        }
+        fprintf(file, "%d\n", n);
+        for (int u = 0; u < n; ++u)
+        {
+            fill(row.begin(), row.end(), 9999);
+            row[u] = 0;
+            for (size_t k = 0; k < byNode[u].size(); ++k)
+                row[byNode[u][k].v] = min(row[byNode[u][k].v], byNode[u][k].cost);
+            for (int v = 0; v < n; ++v)
+                fprintf(file, v + 1 < n ? "%d " : "%d\n", row[v]);
+        }
+    }
+    else
+    {
+        fprintf(file, "%d %zu\n", n, 2 * links.size());
+        for (size_t k = 0; k < links.size(); ++k)
+            fprintf(file, "%d %d %d\n%d %d %d\n", links[k].u, links[k].v, links[k].cost, links[k].v, links[k].u,
+                    links[k].cost);
+    }
+    return fflush(file) == 0 && !ferror(file);
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorOptions options;
+    bool valid = argc >= 3;
+    if (valid)
+    {
+        options.model = argv[1];
+        options.n = atoi(argv[2]);
+    }
+    for (int a = 3; valid && a < argc; a += 2)
+    {
+        string option = argv[a];
+        if (a + 1 >= argc)
+            valid = false;
+        else if (option == "--degree")
+            options.degree = atof(argv[a + 1]);
+        else if (option == "--cost")
+            valid = sscanf(argv[a + 1], "%d,%d", &options.minCost, &options.maxCost) == 2;
+        else if (option == "--alpha")
+            options.alpha = atof(argv[a + 1]);
+        else if (option == "--seed")
+            options.seed = strtoull(argv[a + 1], nullptr, 10);
+        else if (option == "--format")
+            options.format = argv[a + 1];
+        else if (option == "--output")
+            options.output = argv[a + 1];
+        else
+            valid = false;
+    }
+    // Costs stay below routing_sim's INF (9999)
+    if (!valid || options.n < 1 || options.degree < 0 || options.alpha <= 0 || options.minCost < 0 ||
+        options.maxCost < options.minCost || options.maxCost >= 9999 ||
+        (options.format != "edges" && options.format != "matrix"))
+    {
+        cerr << "Usage: " << argv[0] << " er|waxman|ba|grid|fattree <nodes> [--degree <d>] [--cost <min>,<max>]\n"
+             << "       [--alpha <a>] [--seed <s>] [--format edges|matrix] [--output <file>]\n";
+        return EXIT_FAILURE;
+    }
+
+    // The smallest fat tree (k = 2) has 7 nodes; larger requests are rounded down to a whole tree
+    if (options.model == "fattree" && options.n < 7)
+    {
+        cerr << "Error: A fat tree needs at least 7 nodes\n";
+        return EXIT_FAILURE;
+    }
+
+    int n = options.n;
+    vector<Link> links;
+    Generator generator(options);
+    if (!generator.generate(n, links))
+    {
+        cerr << "Error: Unknown model '" << options.model << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+    if (!file)
+    {
+        cerr << "Error: Cannot create output file '" << options.output << "'\n";
+        return EXIT_FAILURE;
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    bool written = writeTopology(file, options.format, n, links);
+    if (file != stdout)
+        written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        cerr << "Error: Cannot write the topology\n";
+        return EXIT_FAILURE;
+    }
+    cerr << options.model << ": " << n << " nodes, " << links.size() << " links\n";
+    return EXIT_SUCCESS;
+}